@@ -2,22 +2,46 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <queue>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <algorithm>
 #include <limits>
 #include <cctype>
 #include <regex>
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
 #include <stdexcept>
 #include <memory>
 #include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <ctime>
+#include <type_traits>
 
 // Cross-platform terminal handling
 #ifdef _WIN32
     #include <conio.h>
     #include <windows.h>
+    #include <direct.h>
 #else
     #include <termios.h>
     #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+#ifdef __linux__
+    #include <sys/sendfile.h>
 #endif
 
 using namespace std;
@@ -32,6 +56,11 @@ class RegularUser;
 class Pet;
 class Application;
 class PetAdoptionSystem;
+class ShelterRegistry;
+
+template <typename T> class PersistentVector;
+typedef PersistentVector<Pet> PetTable;
+typedef PersistentVector<Application> ApplicationTable;
 
 // Custom exceptions
 class InvalidInputException : public runtime_error {
@@ -54,11 +83,161 @@ public:
     AuthorizationException(const string& msg) : runtime_error(msg) {}
 };
 
+// Create a directory if it does not exist yet
+inline void makeDirectory(const string& path) {
+    #ifdef _WIN32
+    int result = _mkdir(path.c_str());
+    #else
+    int result = mkdir(path.c_str(), 0755);
+    #endif
+    if (result != 0 && errno != EEXIST) {
+        throw FileOperationException("Failed to create directory " + path + ": " + strerror(errno));
+    }
+}
+
+// Persistent vector: a 32-way trie with structural sharing. Copying one is
+// O(1) and the copy is an immutable snapshot; later changes copy only the
+// path from the root to the modified leaf (nodes owned by a single version
+// are updated in place). Element access is O(log32 n).
+template <typename T>
+class PersistentVector {
+private:
+    static const unsigned BITS = 5;
+    static const size_t WIDTH = 1 << BITS;
+    static const size_t MASK = WIDTH - 1;
+    
+    struct Node {
+        vector<shared_ptr<Node>> children;  // internal nodes
+        vector<T> values;                   // leaves
+    };
+    
+    shared_ptr<Node> root;
+    size_t count = 0;
+    unsigned shift = 0;     // BITS * (height - 1)
+    
+    static shared_ptr<Node>& own(shared_ptr<Node>& node) {
+        if (!node) {
+            node = make_shared<Node>();
+        } else if (node.use_count() > 1) {
+            node = make_shared<Node>(*node);
+        }
+        return node;
+    }
+    
+    const Node* leafFor(size_t index) const {
+        const Node* node = root.get();
+        for (unsigned level = shift; level > 0; level -= BITS) {
+            node = node->children[(index >> level) & MASK].get();
+        }
+        return node;
+    }
+    
+    // Leaf holding index, copied along the path so this version owns it
+    Node* ownedLeafFor(size_t index) {
+        Node* node = own(root).get();
+        for (unsigned level = shift; level > 0; level -= BITS) {
+            size_t slot = (index >> level) & MASK;
+            if (node->children.size() <= slot) node->children.resize(slot + 1);
+            node = own(node->children[slot]).get();
+        }
+        return node;
+    }
+    
+public:
+    class const_iterator {
+    private:
+        const PersistentVector* vec;
+        size_t index;
+        const Node* leaf;
+    public:
+        const_iterator(const PersistentVector* v, size_t i) : vec(v), index(i), leaf(nullptr) {}
+        const T& operator*() {
+            if (!leaf || (index & MASK) == 0) leaf = vec->leafFor(index);
+            return leaf->values[index & MASK];
+        }
+        const T* operator->() { return &**this; }
+        const_iterator& operator++() {
+            ++index;
+            if ((index & MASK) == 0) leaf = nullptr;
+            return *this;
+        }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+    };
+    
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+    
+    const T& operator[](size_t index) const {
+        return leafFor(index)->values[index & MASK];
+    }
+    
+    const T& back() const { return (*this)[count - 1]; }
+    
+    // Mutable access to one element; other versions keep the old value
+    T& mutableAt(size_t index) {
+        if (index >= count) {
+            throw out_of_range("PersistentVector index out of range");
+        }
+        return ownedLeafFor(index)->values[index & MASK];
+    }
+    
+    void push_back(const T& value) {
+        if (root && count == (size_t(1) << (shift + BITS))) {
+            shared_ptr<Node> newRoot = make_shared<Node>();
+            newRoot->children.push_back(root);
+            root = newRoot;
+            shift += BITS;
+        }
+        ownedLeafFor(count)->values.push_back(value);
+        count++;
+    }
+    
+    void pop_back() {
+        if (count == 0) return;
+        count--;
+        Node* leaf = ownedLeafFor(count);
+        leaf->values.pop_back();
+        if (count == 0) {
+            clear();
+        } else if (shift > 0 && count == (size_t(1) << shift)) {
+            // The last root child became empty: shrink the tree by one level
+            shared_ptr<Node> child = root->children[0];
+            root = child;
+            shift -= BITS;
+        }
+    }
+    
+    // Remove one element, shifting the rest down (O(n) like vector::erase)
+    void erase(size_t index) {
+        if (index >= count) {
+            throw out_of_range("PersistentVector index out of range");
+        }
+        for (size_t i = index; i + 1 < count; ++i) {
+            mutableAt(i) = (*this)[i + 1];
+        }
+        pop_back();
+    }
+    
+    void clear() {
+        root.reset();
+        count = 0;
+        shift = 0;
+    }
+    
+    // True if both versions share the same tree (no change between them)
+    bool sameVersion(const PersistentVector& other) const {
+        return root == other.root && count == other.count;
+    }
+};
+
 // Strategy Pattern: Search Strategy
 class SearchStrategy {
 public:
     virtual ~SearchStrategy() = default;
-    virtual vector<Pet> search(const vector<Pet>& pets) = 0;
+    virtual vector<Pet> search(const PetTable& pets) = 0;
 };
 
 class NameSearchStrategy : public SearchStrategy {
@@ -66,7 +245,7 @@ private:
     string name;
 public:
     NameSearchStrategy(const string& n) : name(n) {}
-    vector<Pet> search(const vector<Pet>& pets) override;
+    vector<Pet> search(const PetTable& pets) override;
 };
 
 class BreedSearchStrategy : public SearchStrategy {
@@ -74,68 +253,471 @@ private:
     string breed;
 public:
     BreedSearchStrategy(const string& b) : breed(b) {}
-    vector<Pet> search(const vector<Pet>& pets) override;
+    vector<Pet> search(const PetTable& pets) override;
+};
+
+// Hash for (username, pet name) pairs used by the duplicate-application guard
+struct ApplicationKeyHash {
+    size_t operator()(const pair<string, string>& key) const {
+        size_t h = hash<string>()(key.first);
+        return h ^ (hash<string>()(key.second) + 0x9e3779b9 + (h << 6) + (h >> 2));
+    }
+};
+
+// Stored records describe their fields once, in file order, as a FieldList of
+// RecordField types bound to member pointers. The codecs below expand that
+// list at compile time, so each record gets its own text, binary and JSON
+// reader and writer without virtual calls or per-field temporary strings.
+enum FieldFlags : unsigned {
+    FIELD_OPTIONAL = 1,     // may be missing from the end of older text records
+    FIELD_REST = 2,         // last text field; takes the rest of the line, commas included
+    FIELD_INTERNAL = 4,     // kept in data files but not in JSON exports
+    FIELD_VERSION = 8,      // the record's version stamp
+    FIELD_ID = 16           // identity assigned by the system; missing from older pet files
+};
+
+template <typename... Fields> struct FieldList {};
+
+template <typename Record, typename T, T Record::*Member, unsigned Flags>
+struct RecordField {
+    typedef Record RecordType;
+    typedef T Type;
+    static const unsigned flags = Flags;
+    static const T& get(const Record& record) { return record.*Member; }
+    static T& ref(Record& record) { return record.*Member; }
+};
+
+// Position of a field in its record's FieldList
+template <typename Field, typename List> struct FieldIndex;
+
+template <typename Field, typename... Rest>
+struct FieldIndex<Field, FieldList<Field, Rest...>> {
+    static const unsigned value = 0;
+};
+
+template <typename Field, typename First, typename... Rest>
+struct FieldIndex<Field, FieldList<First, Rest...>> {
+    static const unsigned value = 1 + FieldIndex<Field, FieldList<Rest...>>::value;
+};
+
+// Field sets for partial reads, writes and comparisons: bit i stands for the
+// i-th field of the record's FieldList
+const uint32_t ALL_FIELDS = ~0u;
+
+template <typename Field>
+constexpr uint32_t fieldBit() {
+    return 1u << FieldIndex<Field, typename Field::RecordType::Fields>::value;
+}
+
+// Declares <member>Field inside a record class; key names the field in JSON
+#define RECORD_FIELD(Record, member, key, flags) \
+    struct member##Field : RecordField<Record, decltype(Record::member), &Record::member, flags> { \
+        static const char* name() { return key; } \
+    }
+
+// Calendar day in UTC, counted from 1970-01-01. Conversions use the
+// days-from-civil algorithm, so no time zone or C library state is involved.
+struct Date {
+    int32_t days;
+    
+    Date() : days(0) {}
+    explicit Date(int32_t d) : days(d) {}
+    
+    static Date today() { return Date(static_cast<int32_t>(time(nullptr) / 86400)); }
+    
+    static Date fromCivil(int year, int month, int day) {
+        year -= month <= 2;
+        int era = (year >= 0 ? year : year - 399) / 400;
+        int yearOfEra = year - era * 400;
+        int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return Date(era * 146097 + dayOfEra - 719468);
+    }
+    
+    void toCivil(int& year, int& month, int& day) const {
+        int z = days + 719468;
+        int era = (z >= 0 ? z : z - 146096) / 146097;
+        int dayOfEra = z - era * 146097;
+        int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int shifted = (5 * dayOfYear + 2) / 153;
+        day = dayOfYear - (153 * shifted + 2) / 5 + 1;
+        month = shifted < 10 ? shifted + 3 : shifted - 9;
+        year = yearOfEra + era * 400 + (month <= 2);
+    }
+    
+    static int daysInMonth(int year, int month) {
+        static const int DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+        return month == 2 && leap ? 29 : DAYS[month - 1];
+    }
+    
+    // Same day of the month, months earlier; the 31st of a shorter month
+    // becomes its last day (so a year before Feb 29 is Feb 28)
+    Date monthsBefore(int months) const {
+        int year, month, day;
+        toCivil(year, month, day);
+        int total = year * 12 + month - 1 - months;
+        year = (total >= 0 ? total : total - 11) / 12;
+        month = total - year * 12 + 1;
+        return fromCivil(year, month, min(day, daysInMonth(year, month)));
+    }
+    
+    // Whole years from this date to day; a birthday on Feb 29 counts from
+    // Mar 1 in other years
+    int yearsUntil(Date day) const {
+        int fromYear, fromMonth, fromDay, toYear, toMonth, toDay;
+        toCivil(fromYear, fromMonth, fromDay);
+        day.toCivil(toYear, toMonth, toDay);
+        return toYear - fromYear - (make_pair(toMonth, toDay) < make_pair(fromMonth, fromDay));
+    }
+    
+    // YYYY-MM-DD; years outside 0-9999 are not expected
+    void appendTo(string& out) const {
+        int year, month, day;
+        toCivil(year, month, day);
+        char text[10] = {
+            static_cast<char>('0' + year / 1000 % 10), static_cast<char>('0' + year / 100 % 10),
+            static_cast<char>('0' + year / 10 % 10), static_cast<char>('0' + year % 10), '-',
+            static_cast<char>('0' + month / 10), static_cast<char>('0' + month % 10), '-',
+            static_cast<char>('0' + day / 10), static_cast<char>('0' + day % 10)
+        };
+        out.append(text, sizeof(text));
+    }
+    
+    string toString() const {
+        string text;
+        appendTo(text);
+        return text;
+    }
+    
+    // YYYY-MM-DD with a valid month and day
+    static bool parse(const char* pos, const char* end, Date& date) {
+        int parts[3] = {0, 0, 0};
+        const int widths[3] = {4, 2, 2};
+        for (int i = 0; i < 3; ++i) {
+            if (i > 0 && (pos == end || *pos++ != '-')) return false;
+            for (int w = 0; w < widths[i]; ++w, ++pos) {
+                if (pos == end || *pos < '0' || *pos > '9') return false;
+                parts[i] = parts[i] * 10 + (*pos - '0');
+            }
+        }
+        if (pos != end || parts[1] < 1 || parts[1] > 12 || parts[2] < 1 ||
+            parts[2] > daysInMonth(parts[0], parts[1])) {
+            return false;
+        }
+        date = fromCivil(parts[0], parts[1], parts[2]);
+        return true;
+    }
+    
+    bool operator==(const Date& other) const { return days == other.days; }
+    bool operator!=(const Date& other) const { return days != other.days; }
 };
 
-class AgeRangeSearchStrategy : public SearchStrategy {
+// Birth dates as accepted by the Add Pet form: a date (YYYY-MM-DD, not in
+// the future) or an age of "2", "3 years" or "6 months" counted back from today
+bool parseAgeText(const string& text, Date& birthDate) {
+    Date today = Date::today();
+    if (Date::parse(text.data(), text.data() + text.size(), birthDate)) return birthDate.days <= today.days;
+    size_t i = 0;
+    int value = 0;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9' && value <= 1000) {
+        value = value * 10 + (text[i++] - '0');
+    }
+    if (i == 0 || value > 1000) return false;
+    while (i < text.size() && text[i] == ' ') i++;
+    string unit = text.substr(i);
+    if (unit.empty() || unit == "year" || unit == "years") birthDate = today.monthsBefore(value * 12);
+    else if (unit == "month" || unit == "months") birthDate = today.monthsBefore(value);
+    else return false;
+    return true;
+}
+
+// Text values: integers in decimal, booleans as 1/0, roles by number, dates
+// as YYYY-MM-DD
+template <typename T>
+typename enable_if<is_integral<T>::value>::type appendText(string& out, T value) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* pos = end;
+    bool negative = value < 0;
+    typename make_unsigned<T>::type rest = negative ? 0 - static_cast<typename make_unsigned<T>::type>(value)
+                                                    : static_cast<typename make_unsigned<T>::type>(value);
+    do {
+        *--pos = static_cast<char>('0' + rest % 10);
+        rest /= 10;
+    } while (rest);
+    if (negative) *--pos = '-';
+    out.append(pos, end - pos);
+}
+
+inline void appendText(string& out, bool value) { out += value ? '1' : '0'; }
+inline void appendText(string& out, Role value) { appendText(out, static_cast<int>(value)); }
+inline void appendText(string& out, const string& value) { out += value; }
+inline void appendText(string& out, Date value) { value.appendTo(out); }
+
+template <typename T>
+typename enable_if<is_integral<T>::value, bool>::type parseText(const char* pos, const char* end, T& value) {
+    bool negative = pos < end && *pos == '-' && is_signed<T>::value;
+    if (negative) ++pos;
+    if (pos == end) return false;
+    typedef typename make_unsigned<T>::type Unsigned;
+    Unsigned limit = negative ? static_cast<Unsigned>(numeric_limits<T>::max()) + 1
+                              : static_cast<Unsigned>(numeric_limits<T>::max());
+    Unsigned result = 0;
+    for (; pos < end; ++pos) {
+        if (*pos < '0' || *pos > '9') return false;
+        unsigned digit = *pos - '0';
+        if (result > (limit - digit) / 10) return false;
+        result = result * 10 + digit;
+    }
+    value = negative ? static_cast<T>(0 - result) : static_cast<T>(result);
+    return true;
+}
+
+// Older files were read with "1" as the only true value, so the same is kept
+inline bool parseText(const char* pos, const char* end, bool& value) {
+    value = end - pos == 1 && *pos == '1';
+    return true;
+}
+
+inline bool parseText(const char* pos, const char* end, Role& value) {
+    int number;
+    if (!parseText(pos, end, number) || (number != static_cast<int>(Role::ADMIN) &&
+                                         number != static_cast<int>(Role::USER))) {
+        return false;
+    }
+    value = static_cast<Role>(number);
+    return true;
+}
+
+inline bool parseText(const char* pos, const char* end, string& value) {
+    value.assign(pos, end - pos);
+    return true;
+}
+
+// Pet files before schema 5 stored an age in whole years instead of a birth
+// date; it is taken as counted back from today
+inline bool parseText(const char* pos, const char* end, Date& value) {
+    if (Date::parse(pos, end, value)) return true;
+    int years;
+    if (!parseText(pos, end, years) || years < 0 || years > 1000) return false;
+    value = Date::today().monthsBefore(years * 12);
+    return true;
+}
+
+// Binary values: fixed-width scalars in host byte order, strings with a
+// 32-bit length prefix. Meant for temporary files read back by this build.
+template <typename T>
+typename enable_if<is_arithmetic<T>::value || is_enum<T>::value>::type appendBinary(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void appendBinary(string& out, Date value) { appendBinary(out, value.days); }
+
+inline void appendBinary(string& out, const string& value) {
+    uint32_t length = static_cast<uint32_t>(value.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out += value;
+}
+
+template <typename T>
+typename enable_if<is_arithmetic<T>::value || is_enum<T>::value, bool>::type
+parseBinary(const char*& pos, const char* end, T& value) {
+    if (static_cast<size_t>(end - pos) < sizeof(T)) return false;
+    memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+inline bool parseBinary(const char*& pos, const char* end, Date& value) {
+    return parseBinary(pos, end, value.days);
+}
+
+inline bool parseBinary(const char*& pos, const char* end, string& value) {
+    uint32_t length;
+    if (!parseBinary(pos, end, length) || static_cast<size_t>(end - pos) < length) return false;
+    value.assign(pos, length);
+    pos += length;
+    return true;
+}
+
+// Comma-separated text lines as stored in the .dat files
+template <typename Record, typename List = typename Record::Fields>
+class TextCodec;
+
+template <typename Record, typename... Fields>
+class TextCodec<Record, FieldList<Fields...>> {
 private:
-    int minAge;
-    int maxAge;
+    template <typename Field>
+    static bool selected(uint32_t fields) {
+        return (fields & fieldBit<Field>()) != 0;
+    }
+    
+    template <typename Field>
+    static void encodeField(const Record& record, string& out, bool& first, uint32_t fields) {
+        if (!selected<Field>(fields)) return;
+        if (!first) out += ',';
+        first = false;
+        appendText(out, Field::get(record));
+    }
+    
+    // more is false once the line has no fields left
+    template <typename Field>
+    static bool decodeField(const char*& pos, const char* end, bool& more, Record& record, unsigned skip,
+                            uint32_t fields) {
+        if ((Field::flags & skip) || !selected<Field>(fields)) return true;
+        if (!more) return (Field::flags & FIELD_OPTIONAL) != 0;
+        const char* stop = end;
+        if (!(Field::flags & FIELD_REST)) {
+            const char* comma = static_cast<const char*>(memchr(pos, ',', end - pos));
+            if (comma) stop = comma;
+        }
+        if (!parseText(pos, stop, Field::ref(record))) return false;
+        more = stop != end;
+        pos = more ? stop + 1 : end;
+        return true;
+    }
+    
+public:
+    // Writes the selected fields, or all of them, in list order
+    static void encode(const Record& record, string& out, uint32_t fields = ALL_FIELDS) {
+        bool first = true;
+        int expand[] = {0, (encodeField<Fields>(record, out, first, fields), 0)...};
+        (void)expand;
+    }
+    
+    // Reads the selected fields from [pos, end). Fields whose flags are in
+    // skip are not stored in the line and keep their current values, as do
+    // unselected fields and optional fields missing from the end.
+    static bool decode(const char* pos, const char* end, Record& record, unsigned skip = 0,
+                       uint32_t fields = ALL_FIELDS) {
+        bool more = true;
+        bool ok = true;
+        int expand[] = {0, (ok = ok && decodeField<Fields>(pos, end, more, record, skip, fields), 0)...};
+        (void)expand;
+        return ok && !more;
+    }
+    
+    static bool decode(const string& line, Record& record, unsigned skip = 0) {
+        return decode(line.data(), line.data() + line.size(), record, skip);
+    }
+};
+
+template <typename Record, typename List = typename Record::Fields>
+class BinaryCodec;
+
+template <typename Record, typename... Fields>
+class BinaryCodec<Record, FieldList<Fields...>> {
+public:
+    static void encode(const Record& record, string& out) {
+        int expand[] = {0, (appendBinary(out, Fields::get(record)), 0)...};
+        (void)expand;
+    }
+    
+    // Reads one record starting at pos and advances past it
+    static bool decode(const char*& pos, const char* end, Record& record) {
+        bool ok = true;
+        int expand[] = {0, (ok = ok && parseBinary(pos, end, Fields::ref(record)), 0)...};
+        (void)expand;
+        return ok;
+    }
+};
+
+// Field-by-field comparison, ignoring fields whose flags are in skip
+template <typename Record, typename List = typename Record::Fields>
+class RecordEquality;
+
+template <typename Record, typename... Fields>
+class RecordEquality<Record, FieldList<Fields...>> {
 public:
-    AgeRangeSearchStrategy(int min, int max) : minAge(min), maxAge(max) {}
-    vector<Pet> search(const vector<Pet>& pets) override;
+    static bool equal(const Record& a, const Record& b, unsigned skip = 0) {
+        bool same = true;
+        int expand[] = {0, (same = same && ((Fields::flags & skip) || Fields::get(a) == Fields::get(b)), 0)...};
+        (void)expand;
+        return same;
+    }
+    
+    // The set of fields that differ
+    static uint32_t diff(const Record& a, const Record& b) {
+        uint32_t changed = 0;
+        int expand[] = {0, (changed |= Fields::get(a) == Fields::get(b) ? 0 : fieldBit<Fields>(), 0)...};
+        (void)expand;
+        return changed;
+    }
 };
 
 // Pet class
 class Pet {
 private:
+    int id = 0;     // stable across renames; 0 until the pet is added to the system
     string name;
     string breed;
-    int age;
+    Date birthDate; // ages are derived from it, so they never need updating
     bool vaccinated;
     bool adopted;
+    int shelterID;  // 0 when the pet is not assigned to a shelter
+    string description;
+    uint64_t version = 1;   // commit that last modified this record; older files count as 1
 public:
-    Pet(string n, string b, int a, bool v)
-        : name(n), breed(b), age(a), vaccinated(v), adopted(false) {}
+    Pet(string n, string b, Date born, bool v, int shelter = 0)
+        : name(n), breed(b), birthDate(born), vaccinated(v), adopted(false), shelterID(shelter) {}
+    
+    // Stored fields in file order. The free-text description may contain
+    // commas, so it is always the last field; id, shelter, version and
+    // description are missing from older files, which store an age in
+    // place of the birth date.
+    RECORD_FIELD(Pet, id, "id", FIELD_INTERNAL | FIELD_ID);
+    RECORD_FIELD(Pet, name, "name", 0);
+    RECORD_FIELD(Pet, breed, "breed", 0);
+    RECORD_FIELD(Pet, birthDate, "birth_date", 0);
+    RECORD_FIELD(Pet, vaccinated, "vaccinated", 0);
+    RECORD_FIELD(Pet, adopted, "adopted", 0);
+    RECORD_FIELD(Pet, shelterID, "shelter_id", FIELD_OPTIONAL);
+    RECORD_FIELD(Pet, version, "version", FIELD_OPTIONAL | FIELD_INTERNAL | FIELD_VERSION);
+    RECORD_FIELD(Pet, description, "description", FIELD_OPTIONAL | FIELD_REST);
+    typedef FieldList<idField, nameField, breedField, birthDateField, vaccinatedField, adoptedField,
+                      shelterIDField, versionField, descriptionField> Fields;
     
     // Serialization for file storage
     string serialize() const {
-        return name + "," + breed + "," + to_string(age) + "," + 
-               (vaccinated ? "1" : "0") + "," + (adopted ? "1" : "0");
+        string out;
+        serializeTo(out);
+        return out;
     }
     
-    // Static method to deserialize from string
-    static Pet deserialize(const string& data) {
-        size_t pos1 = data.find(',');
-        size_t pos2 = data.find(',', pos1+1);
-        size_t pos3 = data.find(',', pos2+1);
-        size_t pos4 = data.find(',', pos3+1);
-        
-        if (pos1 == string::npos || pos2 == string::npos || 
-            pos3 == string::npos || pos4 == string::npos) {
+    void serializeTo(string& out) const { TextCodec<Pet>::encode(*this, out); }
+    
+    // Static method to deserialize from string. Files without a VERSION
+    // header store no version field before the description, and files older
+    // than pets.dat schema 6 store no id.
+    static Pet deserialize(const string& data, bool hasVersion = true, bool hasID = true) {
+        Pet pet("", "", Date(), false);
+        unsigned skip = (hasVersion ? 0u : static_cast<unsigned>(FIELD_VERSION)) |
+                        (hasID ? 0u : static_cast<unsigned>(FIELD_ID));
+        if (!TextCodec<Pet>::decode(data, pet, skip)) {
             throw InvalidInputException("Invalid pet data format");
         }
-        
-        string name = data.substr(0, pos1);
-        string breed = data.substr(pos1+1, pos2-pos1-1);
-        int age = stoi(data.substr(pos2+1, pos3-pos2-1));
-        bool vaccinated = (data.substr(pos3+1, pos4-pos3-1) == "1");
-        
-        Pet pet(name, breed, age, vaccinated);
-        if (data.substr(pos4+1) == "1") {
-            pet.markAsAdopted();
-        }
         return pet;
     }
     
-    string getName() const { return name; }
-    string getBreed() const { return breed; }
-    int getAge() const { return age; }
+    int getID() const { return id; }
+    const string& getName() const { return name; }
+    const string& getBreed() const { return breed; }
+    Date getBirthDate() const { return birthDate; }
+    int getAge(Date today = Date::today()) const { return birthDate.yearsUntil(today); }
     bool isVaccinated() const { return vaccinated; }
     bool isAdopted() const { return adopted; }
+    int getShelterID() const { return shelterID; }
+    const string& getDescription() const { return description; }
+    uint64_t getVersion() const { return version; }
     void markAsAdopted() { adopted = true; }
+    void setID(int petID) { id = petID; }
+    void setVersion(uint64_t v) { version = v; }
+    void setDescription(const string& text) { description = text; }
+    void setShelterID(int id) { shelterID = id; }
     void setVaccinated(bool status) { vaccinated = status; }
-    void setAge(int newAge) { age = newAge; }
+    void setBirthDate(Date date) { birthDate = date; }
     void setName(const string& newName) { name = newName; }
     void setBreed(const string& newBreed) { breed = newBreed; }
 };
@@ -147,453 +729,5871 @@ private:
     string username;
     string petName;
     string status;
+    uint64_t version = 1;   // commit that last modified this record; older files count as 1
+    time_t submittedAt;     // 0 when unknown (older files)
+    time_t decidedAt = 0;   // 0 while pending or unknown
+    int petID;              // 0 when the pet is unknown; older files are matched by name on load
 public:
-    Application(int i, string uname, string pname)
-        : id(i), username(uname), petName(pname), status("Pending") {}
+    Application(int i, string uname, string pname, int pet = 0)
+        : id(i), username(uname), petName(pname), status("Pending"), submittedAt(time(nullptr)),
+          petID(pet) {}
+    
+    // Stored fields in file order; version, timestamps and the pet ID are
+    // missing from older files
+    RECORD_FIELD(Application, id, "id", 0);
+    RECORD_FIELD(Application, username, "username", 0);
+    RECORD_FIELD(Application, petName, "pet_name", 0);
+    RECORD_FIELD(Application, status, "status", 0);
+    RECORD_FIELD(Application, version, "version", FIELD_OPTIONAL | FIELD_INTERNAL | FIELD_VERSION);
+    RECORD_FIELD(Application, submittedAt, "submitted_at", FIELD_OPTIONAL);
+    RECORD_FIELD(Application, decidedAt, "decided_at", FIELD_OPTIONAL);
+    RECORD_FIELD(Application, petID, "pet_id", FIELD_OPTIONAL | FIELD_INTERNAL);
+    typedef FieldList<idField, usernameField, petNameField, statusField, versionField,
+                      submittedAtField, decidedAtField, petIDField> Fields;
     
     // Serialization for file storage
     string serialize() const {
-        return to_string(id) + "," + username + "," + petName + "," + status;
+        string out;
+        serializeTo(out);
+        return out;
     }
     
+    void serializeTo(string& out) const { TextCodec<Application>::encode(*this, out); }
+    
     // Static method to deserialize from string
     static Application deserialize(const string& data) {
-        size_t pos1 = data.find(',');
-        size_t pos2 = data.find(',', pos1+1);
-        size_t pos3 = data.find(',', pos2+1);
-        
-        if (pos1 == string::npos || pos2 == string::npos || pos3 == string::npos) {
+        Application app(0, "", "");
+        app.submittedAt = 0;
+        if (!TextCodec<Application>::decode(data, app)) {
             throw InvalidInputException("Invalid application data format");
         }
-        
-        int id = stoi(data.substr(0, pos1));
-        string username = data.substr(pos1+1, pos2-pos1-1);
-        string petName = data.substr(pos2+1, pos3-pos2-1);
-        string status = data.substr(pos3+1);
-        
-        Application app(id, username, petName);
-        if (status == "Approved") {
-            app.approve();
-        } else if (status == "Rejected") {
-            app.reject();
-        }
         return app;
     }
     
     int getID() const { return id; }
-    string getPetName() const { return petName; }
-    string getUsername() const { return username; }
-    string getStatus() const { return status; }
-    void approve() { status = "Approved"; }
-    void reject() { status = "Rejected"; }
+    const string& getPetName() const { return petName; }
+    int getPetID() const { return petID; }
+    void setPetID(int pet) { petID = pet; }
+    const string& getUsername() const { return username; }
+    const string& getStatus() const { return status; }
+    uint64_t getVersion() const { return version; }
+    void setVersion(uint64_t v) { version = v; }
+    time_t getSubmittedAt() const { return submittedAt; }
+    void setSubmittedAt(time_t when) { submittedAt = when; }
+    time_t getDecidedAt() const { return decidedAt; }
+    void approve(time_t when = time(nullptr)) { status = "Approved"; decidedAt = when; }
+    void reject(time_t when = time(nullptr)) { status = "Rejected"; decidedAt = when; }
 };
 
-// User class (Abstract)
-class User {
-protected:
-    string username;
-    string password;
-    Role role;
+// Shelter class
+class Shelter {
+private:
+    int id;
+    string name;
+    double latitude;
+    double longitude;
 public:
-    User(string uname, string pwd, Role r) : username(uname), password(pwd), role(r) {}
-    virtual ~User() = default;
-    
-    string getUsername() const { return username; }
-    string getPassword() const { return password; }
-    Role getRole() const { return role; }
-    void setUsername(const string& uname) { username = uname; }
-    void setPassword(const string& pwd) { password = pwd; }
+    Shelter(int i, string n, double lat, double lon)
+        : id(i), name(n), latitude(lat), longitude(lon) {}
     
-    virtual void showDashboard() = 0;
-    virtual void performAction(PetAdoptionSystem& system) = 0;
+    // Serialization for file storage
+    string serialize() const {
+        ostringstream out;
+        out << id << "," << name << "," << setprecision(9) << latitude << "," << longitude;
+        return out.str();
+    }
     
-    bool authenticate(string uname, string pwd) const {
-        return (username == uname && password == pwd);
+    // Static method to deserialize from string
+    static Shelter deserialize(const string& data) {
+        size_t pos1 = data.find(',');
+        size_t pos2 = data.find(',', pos1+1);
+        size_t pos3 = data.find(',', pos2+1);
+        
+        if (pos1 == string::npos || pos2 == string::npos || pos3 == string::npos) {
+            throw InvalidInputException("Invalid shelter data format");
+        }
+        
+        return Shelter(stoi(data.substr(0, pos1)),
+                       data.substr(pos1+1, pos2-pos1-1),
+                       stod(data.substr(pos2+1, pos3-pos2-1)),
+                       stod(data.substr(pos3+1)));
     }
     
-    friend class PetAdoptionSystem;
+    int getID() const { return id; }
+    string getName() const { return name; }
+    double getLatitude() const { return latitude; }
+    double getLongitude() const { return longitude; }
 };
 
-// Admin class
-class Admin : public User {
-public:
-    Admin(string uname, string pwd) : User(uname, pwd, Role::ADMIN) {}
+// Optional criteria applied together with location queries
+struct PetFilter {
+    string breed;               // substring match, empty for any
+    int minAge = 0;
+    int maxAge = numeric_limits<int>::max();
+    bool vaccinatedOnly = false;
     
-    void showDashboard() override {
-        cout << "\n==== ADMIN DASHBOARD ====\n";
-        cout << "1. Add Another Admin\n";
-        cout << "2. Manage User Accounts\n";
-        cout << "3. Manage Pet Records\n";
-        cout << "4. Process Applications\n";
-        cout << "5. Search Pets\n";
-        cout << "6. Logout\n";
+    bool matches(const Pet& pet) const {
+        return pet.getAge() >= minAge && pet.getAge() <= maxAge &&
+               (!vaccinatedOnly || pet.isVaccinated()) && matchesBreed(pet.getBreed());
     }
     
-    void performAction(PetAdoptionSystem& system) override;
-};
-
-// Regular User class
-class RegularUser : public User {
-public:
-    RegularUser(string uname, string pwd) : User(uname, pwd, Role::USER) {}
-    
-    void showDashboard() override {
-        cout << "\n==== USER DASHBOARD ====\n";
-        cout << "1. Browse Pets\n";
-        cout << "2. Check Application Status\n";
-        cout << "3. View History\n";
-        cout << "4. Logout\n";
+    bool matchesBreed(const string& petBreed) const {
+        return breed.empty() || petBreed.find(breed) != string::npos;
     }
     
-    void performAction(PetAdoptionSystem& system) override;
+    // Birth days (inclusive) of pets aged minAge..maxAge today; empty when
+    // first > second
+    pair<int32_t, int32_t> birthDayRange() const {
+        int youngest = max(minAge, 0), oldest = min(maxAge, 1000);
+        if (youngest > oldest) return make_pair(1, 0);
+        Date today = Date::today();
+        return make_pair(today.monthsBefore((oldest + 1) * 12).days + 1,
+                         today.monthsBefore(youngest * 12).days);
+    }
 };
 
-// Singleton Pattern: PetAdoptionSystem
-class PetAdoptionSystem {
+// Ad-hoc pet filters such as
+//     breed ~ "lab" and age <= 3 and vaccinated and not adopted
+// Conditions compare a field with a literal and combine with and, or, not and
+// parentheses; yes/no fields stand alone or compare with true/false. Text
+// fields take quoted values with = != and ~ (contains, ignoring case), age
+// takes whole years and born takes a "YYYY-MM-DD" date. The parser builds a
+// tree, the type checker lowers each comparison against the Pet fields to one
+// of four tests (ages become birth-date ranges), and the tree is compiled to
+// postfix bytecode. The bytecode runs over batches of pets, one instruction
+// across the whole batch at a time, so dispatch costs are paid per batch
+// rather than per pet.
+class PetQuery {
+public:
+    static const size_t BATCH_SIZE = 256;
+    
 private:
-    static PetAdoptionSystem* instance;
-    vector<unique_ptr<User>> users;
-    vector<Pet> pets;
-    vector<Application> applications;
-    int nextAppID = 1;
+    enum Field : uint8_t { NAME, BREED, DESCRIPTION, BORN, SHELTER, VACCINATED, ADOPTED };
+    enum Op : uint8_t { TEXT_EQUALS, TEXT_CONTAINS, IN_RANGE, IS_TRUE, AND, OR, NOT };
+    enum Type { TEXT, NUMBER, AGE, DATE, FLAG };
     
-bool validateYesNo(const string& input) {
-    if (input != "Y" && input != "y") {
-        cout << "Invalid input. Please input only Y or y.\n";
-        return false;
-    }
-    return true;
-}
+    struct Instruction {
+        Op op;
+        Field field;
+        uint16_t operand;   // index into texts or ranges
+    };
     
+    struct Token {
+        enum Kind { WORD, NUMBER, TEXT, SYMBOL, END } kind;
+        string text;
+        size_t position;
+    };
     
+    struct Node {
+        Op op;                          // a test, or AND/OR/NOT over the children
+        Instruction test;
+        unique_ptr<Node> left, right;
+    };
     
-    // Private constructor for singleton
-    PetAdoptionSystem() {
-        loadUsersFromFile();
-        if (users.empty()) {
-            users.push_back(unique_ptr<User>(new Admin("admin", "admin123")));
-            saveUsersToFile();
-        }
-        
-        loadPetsFromFile();
-        // Add default pets only if no pets were loaded
-        if (pets.empty()) {
-            pets.push_back(Pet("Whiskers", "Siamese", 2, true));
-            pets.push_back(Pet("Rex", "Labrador", 3, true));
-            savePetsToFile();
+    vector<Instruction> code;
+    vector<string> texts;
+    vector<pair<int64_t, int64_t>> ranges;  // inclusive bounds
+    size_t maxDepth = 0;
+    
+    // Planner hints from the conditions every match must meet
+    bool hasExactName = false;
+    string exactName;
+    int64_t bornFrom = numeric_limits<int64_t>::min();
+    int64_t bornTo = numeric_limits<int64_t>::max();
+    
+    // Parser state, used only while compiling
+    vector<Token> tokens;
+    size_t next = 0;
+    Date today;
+    
+    static InvalidInputException error(const Token& token, const string& message) {
+        return InvalidInputException(message + " at position " + to_string(token.position + 1));
+    }
+    
+    void tokenize(const string& text) {
+        size_t i = 0;
+        while (true) {
+            while (i < text.size() && isspace(static_cast<unsigned char>(text[i]))) i++;
+            Token token = { Token::END, "", i };
+            if (i == text.size()) {
+                tokens.push_back(token);
+                return;
+            }
+            char c = text[i];
+            if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                token.kind = Token::WORD;
+                while (i < text.size() && (isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_')) {
+                    token.text += static_cast<char>(tolower(static_cast<unsigned char>(text[i++])));
+                }
+            } else if (isdigit(static_cast<unsigned char>(c)) || (c == '-' && i + 1 < text.size() &&
+                                                                  isdigit(static_cast<unsigned char>(text[i + 1])))) {
+                token.kind = Token::NUMBER;
+                token.text += text[i++];
+                while (i < text.size() && isdigit(static_cast<unsigned char>(text[i]))) token.text += text[i++];
+                if (token.text.size() > 12) throw error(token, "Number too large");
+            } else if (c == '"') {
+                token.kind = Token::TEXT;
+                for (i++; i < text.size() && text[i] != '"'; i++) {
+                    if (text[i] == '\\' && i + 1 < text.size()) i++;
+                    token.text += text[i];
+                }
+                if (i == text.size()) throw error(token, "Unterminated text");
+                i++;
+            } else {
+                token.kind = Token::SYMBOL;
+                static const char* SYMBOLS[] = {"!=", "<=", ">=", "==", "=", "<", ">", "~", "(", ")"};
+                for (const char* symbol : SYMBOLS) {
+                    if (text.compare(i, strlen(symbol), symbol) == 0) {
+                        token.text = symbol;
+                        break;
+                    }
+                }
+                if (token.text.empty()) throw error(token, string("Unexpected '") + c + "'");
+                i += token.text.size();
+                if (token.text == "==") token.text = "=";
+            }
+            tokens.push_back(token);
         }
-        
-        loadApplicationsFromFile();
     }
     
-    // File handling functions
-    void saveUsersToFile();
-    void loadUsersFromFile();
-    void savePetsToFile();
-    void loadPetsFromFile();
-    void saveApplicationsToFile();
-    void loadApplicationsFromFile();
+    const Token& peek() const { return tokens[next]; }
     
-    // Helper functions
-    void clearScreen() const {
-        system("cls || clear");
+    bool accept(Token::Kind kind, const char* text) {
+        if (peek().kind != kind || peek().text != text) return false;
+        next++;
+        return true;
     }
     
-    string getHiddenInput(const string& prompt) const {
-        string input;
-        cout << prompt;
+    static unique_ptr<Node> combine(Op op, unique_ptr<Node> left, unique_ptr<Node> right = nullptr) {
+        unique_ptr<Node> node(new Node());
+        node->op = op;
+        node->left = move(left);
+        node->right = move(right);
+        return node;
+    }
+    
+    unique_ptr<Node> parseOr() {
+        unique_ptr<Node> node = parseAnd();
+        while (accept(Token::WORD, "or")) node = combine(OR, move(node), parseAnd());
+        return node;
+    }
+    
+    unique_ptr<Node> parseAnd() {
+        unique_ptr<Node> node = parseUnary();
+        while (accept(Token::WORD, "and")) node = combine(AND, move(node), parseUnary());
+        return node;
+    }
+    
+    unique_ptr<Node> parseUnary() {
+        if (accept(Token::WORD, "not")) return combine(NOT, parseUnary());
+        if (accept(Token::SYMBOL, "(")) {
+            unique_ptr<Node> node = parseOr();
+            if (!accept(Token::SYMBOL, ")")) throw error(peek(), "Expected ')'");
+            return node;
+        }
+        if (peek().kind != Token::WORD) throw error(peek(), "Expected a field name");
+        const Token& field = tokens[next++];
+        const Token* op = nullptr;
+        const Token* literal = nullptr;
+        if (peek().kind == Token::SYMBOL && peek().text != "(" && peek().text != ")") {
+            op = &tokens[next++];
+            literal = &tokens[next++];
+            if (literal->kind == Token::END) throw error(*literal, "Expected a value after " + op->text);
+        }
+        return check(field, op, literal);
+    }
+    
+    // Type checker: resolves the field and lowers the comparison to a test
+    unique_ptr<Node> check(const Token& field, const Token* op, const Token* literal) {
+        static const struct { const char* name; Field field; Type type; } FIELDS[] = {
+            {"name", NAME, TEXT}, {"breed", BREED, TEXT}, {"description", DESCRIPTION, TEXT},
+            {"age", BORN, AGE}, {"born", BORN, DATE}, {"shelter", SHELTER, NUMBER},
+            {"vaccinated", VACCINATED, FLAG}, {"adopted", ADOPTED, FLAG}
+        };
+        Type type = TEXT;
+        Instruction test = { IS_TRUE, NAME, 0 };
+        bool found = false;
+        for (const auto& entry : FIELDS) {
+            if (field.text == entry.name) {
+                test.field = entry.field;
+                type = entry.type;
+                found = true;
+            }
+        }
+        if (!found) {
+            throw error(field, "Unknown field " + field.text +
+                        " (fields: name, breed, description, age, born, shelter, vaccinated, adopted)");
+        }
         
-        #ifdef _WIN32
-        // Windows implementation
-        char ch;
-        while ((ch = _getch()) != '\r') {
-            if (ch == '\b') {
-                if (!input.empty()) {
-                    cout << "\b \b";
-                    input.pop_back();
-                }
-            } else {
-                cout << '*';
-                input.push_back(ch);
+        if (type == FLAG) {
+            if (!op) return leaf(test);
+            if ((op->text != "=" && op->text != "!=") || literal->kind != Token::WORD ||
+                (literal->text != "true" && literal->text != "false")) {
+                throw error(*op, field.text + " is a yes/no field; use it alone or with = true or = false");
             }
+            bool negate = (op->text == "!=") != (literal->text == "false");
+            return negate ? combine(NOT, leaf(test)) : leaf(test);
         }
-        #else
-        // Unix/Linux/macOS implementation using termios directly
-        termios oldt, newt;
-        tcgetattr(STDIN_FILENO, &oldt);
-        newt = oldt;
-        newt.c_lflag &= ~(ECHO | ICANON);
-        tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+        if (!op) throw error(field, field.text + " needs a comparison");
         
-        char ch;
-        while ((ch = getchar()) != '\n') {
-            if (ch == 127 || ch == 8) { // Backspace or Delete
-                if (!input.empty()) {
-                    cout << "\b \b";
-                    input.pop_back();
-                }
-            } else {
-                cout << '*';
-                input.push_back(ch);
+        if (type == TEXT) {
+            if (op->text != "=" && op->text != "!=" && op->text != "~") {
+                throw error(*op, field.text + " is a text field; compare it with =, != or ~");
             }
+            if (literal->kind != Token::TEXT) throw error(*literal, field.text + " needs a quoted text value");
+            string value = literal->text;
+            if (op->text == "~") {
+                for (char& c : value) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            }
+            test.op = op->text == "~" ? TEXT_CONTAINS : TEXT_EQUALS;
+            test.operand = static_cast<uint16_t>(texts.size());
+            texts.push_back(value);
+            return op->text == "!=" ? combine(NOT, leaf(test)) : leaf(test);
         }
         
-        // Restore terminal settings
-        tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-        #endif
+        if (op->text == "~") throw error(*op, "~ only applies to text fields");
+        int64_t value;
+        Date date;
+        if (type == DATE) {
+            if (literal->kind != Token::TEXT ||
+                !Date::parse(literal->text.data(), literal->text.data() + literal->text.size(), date)) {
+                throw error(*literal, "born needs a date like \"2021-06-30\"");
+            }
+            value = date.days;
+        } else {
+            if (literal->kind != Token::NUMBER) throw error(*literal, field.text + " needs a whole number");
+            value = stoll(literal->text);
+        }
         
-        cout << endl;
-        return input;
+        // Closed range of values satisfying the comparison; != is = negated
+        int64_t low = numeric_limits<int64_t>::min(), high = numeric_limits<int64_t>::max();
+        const string& cmp = op->text;
+        if (cmp == "=" || cmp == "!=") low = high = value;
+        else if (cmp == "<") high = value - 1;
+        else if (cmp == "<=") high = value;
+        else if (cmp == ">") low = value + 1;
+        else low = value;
+        if (type == AGE) {
+            // Age a..b in years today is a birth date after the day b + 1
+            // years ago, up to the day a years ago
+            int64_t youngest = max<int64_t>(low, 0), oldest = min<int64_t>(high, 1000);
+            if (youngest > oldest) {
+                low = 1;
+                high = 0;
+            } else {
+                low = today.monthsBefore(static_cast<int>(oldest + 1) * 12).days + 1;
+                high = today.monthsBefore(static_cast<int>(youngest) * 12).days;
+            }
+        }
+        test.op = IN_RANGE;
+        test.operand = static_cast<uint16_t>(ranges.size());
+        ranges.push_back(make_pair(low, high));
+        return cmp == "!=" ? combine(NOT, leaf(test)) : leaf(test);
     }
     
-    string getValidatedInput(const string& prompt, bool (*validator)(const string&), 
-                           const string& errorMsg, int maxAttempts = 3) const {
-        string input;
-        int attempts = 0;
-        while (attempts < maxAttempts) {
-            cout << prompt;
-            getline(cin >> ws, input);
-            if (input == "0") return input;
-            if (validator(input)) {
-                return input;
-            }
-            cout << errorMsg << " (" << maxAttempts - attempts - 1
-                 << " attempts remaining, or '0' to cancel)\n";
-            attempts++;
+    static unique_ptr<Node> leaf(const Instruction& test) {
+        unique_ptr<Node> node(new Node());
+        node->op = test.op;
+        node->test = test;
+        return node;
+    }
+    
+    // Postfix order; returns the stack depth the subtree needs
+    size_t emit(const Node& node) {
+        if (node.op == AND || node.op == OR) {
+            size_t left = emit(*node.left);
+            size_t right = emit(*node.right);
+            code.push_back(Instruction{node.op, NAME, 0});
+            return max(left, right + 1);
         }
-        throw InvalidInputException("Too many failed attempts");
+        if (node.op == NOT) {
+            size_t depth = emit(*node.left);
+            code.push_back(Instruction{NOT, NAME, 0});
+            return depth;
+        }
+        code.push_back(node.test);
+        return 1;
     }
     
-    int getNumericInput(const string& prompt, int min, int max, int maxAttempts = 3) const {
-        int value;
-        int attempts = 0;
-        string input;
-        
-        while (attempts < maxAttempts) {
-            cout << prompt;
-            getline(cin, input);
-            
-            if (!regex_match(input, regex("^\\s*\\d+\\s*$"))) {
-                cout << "Invalid input format. Please enter a whole number between " 
-                     << min << " and " << max << ".\n";
-                attempts++;
-                continue;
-            }
-            
-            try {
-                value = stoi(input);
-                if (value >= min && value <= max) {
-                    return value;
-                }
-                cout << "Please enter between " << min << " and " << max
-                     << " (" << maxAttempts - attempts - 1 << " attempts left)\n";
-            } catch (...) {
-                cout << "Invalid input. Please enter a number between "
-                     << min << " and " << max << ".\n";
-            }
-            attempts++;
+    // Record what the conditions joined by top-level ands pin down
+    void collectHints(const Node& node) {
+        if (node.op == AND) {
+            collectHints(*node.left);
+            collectHints(*node.right);
+        } else if (node.op == TEXT_EQUALS && node.test.field == NAME) {
+            hasExactName = true;
+            exactName = texts[node.test.operand];
+        } else if (node.op == IN_RANGE && node.test.field == BORN) {
+            bornFrom = max(bornFrom, ranges[node.test.operand].first);
+            bornTo = min(bornTo, ranges[node.test.operand].second);
         }
-        throw InvalidInputException("Too many failed attempts");
     }
     
-    int getAgeInput(const string& prompt) const {
-        string input;
-        while (true) {
-            cout << prompt;
-            getline(cin, input);
-            
-            if (regex_match(input, regex("^\\d+$"))) {
-                return stoi(input);
-            }
-            
-            smatch matches;
-            if (regex_match(input, matches, regex("^(\\d+)\\s*(years?|months?)$"))) {
-                int value = stoi(matches[1].str());
-                string unit = matches[2].str();
-                if (unit.find("month") != string::npos) {
-                    return value / 12;
+    static bool containsIgnoringCase(const string& text, const string& lowerNeedle) {
+        return search(text.begin(), text.end(), lowerNeedle.begin(), lowerNeedle.end(), [](char a, char b) {
+            return tolower(static_cast<unsigned char>(a)) == b;
+        }) != text.end();
+    }
+    
+    typedef const string& (Pet::*TextGetter)() const;
+    
+    static TextGetter textGetter(Field field) {
+        return field == NAME ? &Pet::getName : field == BREED ? &Pet::getBreed : &Pet::getDescription;
+    }
+    
+public:
+    // Throws InvalidInputException naming the position of the first problem
+    static PetQuery compile(const string& text) {
+        PetQuery query;
+        query.today = Date::today();
+        query.tokenize(text);
+        unique_ptr<Node> root = query.parseOr();
+        if (query.peek().kind != Token::END) throw error(query.peek(), "Unexpected '" + query.peek().text + "'");
+        if (query.texts.size() + query.ranges.size() > numeric_limits<uint16_t>::max()) {
+            throw InvalidInputException("Query too long");
+        }
+        query.maxDepth = query.emit(*root);
+        query.collectHints(*root);
+        query.tokens.clear();
+        return query;
+    }
+    
+    // Index hints: every match has this name, or a birth date in this range
+    const string* getExactName() const { return hasExactName ? &exactName : nullptr; }
+    
+    bool getBornRange(int64_t& from, int64_t& to) const {
+        from = bornFrom;
+        to = bornTo;
+        return bornFrom != numeric_limits<int64_t>::min() || bornTo != numeric_limits<int64_t>::max();
+    }
+    
+    // Sets matches[i] to 1 if pets[i] matches, for up to BATCH_SIZE pets
+    void evaluate(const Pet* const* pets, size_t count, uint8_t* matches) const {
+        vector<uint8_t> stack(maxDepth * BATCH_SIZE);
+        size_t depth = 0;
+        for (const Instruction& instruction : code) {
+            uint8_t* top = stack.data() + depth * BATCH_SIZE;
+            switch (instruction.op) {
+                case TEXT_EQUALS: {
+                    const string& value = texts[instruction.operand];
+                    auto getter = textGetter(instruction.field);
+                    for (size_t i = 0; i < count; ++i) top[i] = (pets[i]->*getter)() == value;
+                    depth++;
+                    break;
+                }
+                case TEXT_CONTAINS: {
+                    const string& value = texts[instruction.operand];
+                    auto getter = textGetter(instruction.field);
+                    for (size_t i = 0; i < count; ++i) top[i] = containsIgnoringCase((pets[i]->*getter)(), value);
+                    depth++;
+                    break;
+                }
+                case IN_RANGE: {
+                    int64_t low = ranges[instruction.operand].first, high = ranges[instruction.operand].second;
+                    if (instruction.field == BORN) {
+                        for (size_t i = 0; i < count; ++i) {
+                            int64_t value = pets[i]->getBirthDate().days;
+                            top[i] = (value >= low) & (value <= high);
+                        }
+                    } else {
+                        for (size_t i = 0; i < count; ++i) {
+                            int64_t value = pets[i]->getShelterID();
+                            top[i] = (value >= low) & (value <= high);
+                        }
+                    }
+                    depth++;
+                    break;
+                }
+                case IS_TRUE: {
+                    bool (Pet::*getter)() const = instruction.field == VACCINATED ? &Pet::isVaccinated : &Pet::isAdopted;
+                    for (size_t i = 0; i < count; ++i) top[i] = (pets[i]->*getter)();
+                    depth++;
+                    break;
+                }
+                case AND:
+                case OR: {
+                    uint8_t* left = top - 2 * BATCH_SIZE;
+                    const uint8_t* right = top - BATCH_SIZE;
+                    if (instruction.op == AND) {
+                        for (size_t i = 0; i < count; ++i) left[i] &= right[i];
+                    } else {
+                        for (size_t i = 0; i < count; ++i) left[i] |= right[i];
+                    }
+                    depth--;
+                    break;
+                }
+                case NOT: {
+                    uint8_t* operand = top - BATCH_SIZE;
+                    for (size_t i = 0; i < count; ++i) operand[i] ^= 1;
+                    break;
                 }
-                return value;
             }
-            cout << "Invalid age format. Please enter like '2', '3 years', or '6 months'\n";
         }
+        memcpy(matches, stack.data(), count);
     }
+};
 
-public:
-    // Delete copy constructor and assignment operator
-    PetAdoptionSystem(const PetAdoptionSystem&) = delete;
-    PetAdoptionSystem& operator=(const PetAdoptionSystem&) = delete;
+// 2-d tree over the locations of shelters with available pets. Coordinates are
+// projected to kilometres around the network's mean latitude, which is
+// accurate enough at the scale of a regional shelter network. Each shelter
+// groups its available pets by breed, with every group ordered by birth date
+// and kept twice (all pets, vaccinated only), so a filter costs one substring
+// test per breed and a binary search for the age range rather than a pass
+// over the shelter's pets.
+class PetLocator {
+private:
+    typedef pair<int32_t, size_t> Stock;    // (birth day, pet index)
     
-    // Singleton access method
-    static PetAdoptionSystem& getInstance() {
-        if (!instance) {
-            instance = new PetAdoptionSystem();
-        }
-        return *instance;
-    }
+    struct BreedStock {
+        string breed;
+        vector<Stock> all;
+        vector<Stock> vaccinated;
+    };
     
-    // Destructor
-    ~PetAdoptionSystem() {
-        saveUsersToFile();
+    struct Site {
+        double x, y;    // km
+        vector<BreedStock> breeds;
+    };
+    
+    vector<Site> sites;     // stored in k-d tree order: median at the middle
+    double refLatitudeCos = 1.0;
+    
+    static constexpr double KM_PER_DEGREE = 111.32;
+    
+    void buildTree(size_t begin, size_t end, int depth) {
+        if (end - begin <= 1) return;
+        size_t mid = (begin + end) / 2;
+        bool byX = (depth % 2 == 0);
+        nth_element(sites.begin() + begin, sites.begin() + mid, sites.begin() + end,
+                    [byX](const Site& a, const Site& b) {
+                        return byX ? a.x < b.x : a.y < b.y;
+                    });
+        buildTree(begin, mid, depth + 1);
+        buildTree(mid + 1, end, depth + 1);
     }
     
-    // Main system operations
-    void run();
-    void registerUser(Role role);
-    User* login(Role role);
+    static double squared(double v) { return v * v; }
     
-    // Pet operations
-    void addPet(const string& name, const string& breed, int age, bool vaccinated) {
-        pets.emplace_back(name, breed, age, vaccinated);
-        savePetsToFile(); // Save after adding
+    // Calls visit(pet index) for each pet at the site matching the filter,
+    // stopping early when it returns false
+    template <typename Visit>
+    static void forEachMatch(const Site& site, const PetFilter& filter, Visit visit) {
+        pair<int32_t, int32_t> born = filter.birthDayRange();
+        if (born.first > born.second) return;
+        for (const auto& group : site.breeds) {
+            if (!filter.matchesBreed(group.breed)) continue;
+            const vector<Stock>& stock = filter.vaccinatedOnly ? group.vaccinated : group.all;
+            auto it = lower_bound(stock.begin(), stock.end(), Stock(born.first, 0));
+            for (; it != stock.end() && it->first <= born.second; ++it) {
+                if (!visit(it->second)) return;
+            }
+        }
     }
     
-    void editPet(size_t index, const string& name, const string& breed, int age, bool vaccinated) {
-        if (index >= pets.size()) {
-            throw out_of_range("Invalid pet index");
+    void collectWithin(size_t begin, size_t end, int depth, double x, double y, double radius,
+                       const PetFilter& filter, vector<pair<double, size_t>>& out) const {
+        if (begin >= end) return;
+        size_t mid = (begin + end) / 2;
+        const Site& site = sites[mid];
+        double dist2 = squared(site.x - x) + squared(site.y - y);
+        if (dist2 <= radius * radius) {
+            double dist = sqrt(dist2);
+            forEachMatch(site, filter, [&](size_t pet) {
+                out.emplace_back(dist, pet);
+                return true;
+            });
         }
-        pets[index].setName(name);
-        pets[index].setBreed(breed);
-        pets[index].setAge(age);
-        pets[index].setVaccinated(vaccinated);
-        savePetsToFile(); // Save after editing
+        double delta = (depth % 2 == 0) ? x - site.x : y - site.y;
+        if (delta <= radius) collectWithin(begin, mid, depth + 1, x, y, radius, filter, out);
+        if (delta >= -radius) collectWithin(mid + 1, end, depth + 1, x, y, radius, filter, out);
     }
     
-    void deletePet(size_t index) {
-        if (index >= pets.size()) {
-            throw out_of_range("Invalid pet index");
+    void collectNearest(size_t begin, size_t end, int depth, double x, double y, size_t k,
+                        const PetFilter& filter, vector<pair<double, size_t>>& heap) const {
+        if (begin >= end) return;
+        size_t mid = (begin + end) / 2;
+        const Site& site = sites[mid];
+        double dist2 = squared(site.x - x) + squared(site.y - y);
+        forEachMatch(site, filter, [&](size_t pet) {
+            pair<double, size_t> entry(dist2, pet);
+            if (heap.size() < k) {
+                heap.push_back(entry);
+                push_heap(heap.begin(), heap.end());
+            } else if (entry < heap.front()) {
+                pop_heap(heap.begin(), heap.end());
+                heap.back() = entry;
+                push_heap(heap.begin(), heap.end());
+            } else {
+                // Pets at one site share the distance, so past the kth
+                // distance none of the rest can enter
+                return dist2 <= heap.front().first;
+            }
+            return true;
+        });
+        double delta = (depth % 2 == 0) ? x - site.x : y - site.y;
+        bool leftFirst = delta < 0;
+        collectNearest(leftFirst ? begin : mid + 1, leftFirst ? mid : end,
+                       depth + 1, x, y, k, filter, heap);
+        if (heap.size() < k || delta * delta <= heap.front().first) {
+            collectNearest(leftFirst ? mid + 1 : begin, leftFirst ? end : mid,
+                           depth + 1, x, y, k, filter, heap);
         }
-        pets.erase(pets.begin() + index);
-        savePetsToFile(); // Save after deleting
     }
     
-    void viewAllPets() const {
-        clearScreen();
-        cout << "\n=== ALL PET RECORDS ===\n";
-        if (pets.empty()) {
-            cout << "No pets in the system.\n";
-            return;
+public:
+    // Index every available pet whose shelter has a known location
+    void build(const PetTable& pets, const vector<Shelter>& shelters) {
+        sites.clear();
+        unordered_map<int, const Shelter*> byID;
+        double latSum = 0.0;
+        for (const auto& shelter : shelters) {
+            byID[shelter.getID()] = &shelter;
+            latSum += shelter.getLatitude();
         }
+        const double degToRad = acos(-1.0) / 180.0;
+        refLatitudeCos = shelters.empty() ? 1.0 : cos(latSum / shelters.size() * degToRad);
         
-        cout << "ID  | Name          | Breed         | Age | Vaccinated | Status\n";
-        cout << "----+---------------+---------------+-----+------------+--------\n";
-        
+        unordered_map<int, size_t> siteOf;
+        vector<unordered_map<string, size_t>> groupOf;
         for (size_t i = 0; i < pets.size(); ++i) {
             const Pet& pet = pets[i];
-            cout << left << setw(4) << i+1 << "| "
-                 << setw(15) << pet.getName() << "| "
-                 << setw(15) << pet.getBreed() << "| "
-                 << setw(5) << pet.getAge() << "| "
-                 << setw(12) << (pet.isVaccinated() ? "Yes" : "No") << "| "
-                 << (pet.isAdopted() ? "Adopted" : "Available") << "\n";
+            auto shelter = byID.find(pet.getShelterID());
+            if (pet.isAdopted() || shelter == byID.end()) continue;
+            auto placed = siteOf.insert(make_pair(pet.getShelterID(), sites.size()));
+            if (placed.second) {
+                Site site;
+                site.x = shelter->second->getLongitude() * KM_PER_DEGREE * refLatitudeCos;
+                site.y = shelter->second->getLatitude() * KM_PER_DEGREE;
+                sites.push_back(site);
+                groupOf.emplace_back();
+            }
+            Site& site = sites[placed.first->second];
+            auto grouped = groupOf[placed.first->second].insert(
+                make_pair(pet.getBreed(), site.breeds.size()));
+            if (grouped.second) {
+                site.breeds.emplace_back();
+                site.breeds.back().breed = pet.getBreed();
+            }
+            BreedStock& group = site.breeds[grouped.first->second];
+            Stock stock(pet.getBirthDate().days, i);
+            group.all.push_back(stock);
+            if (pet.isVaccinated()) group.vaccinated.push_back(stock);
+        }
+        for (auto& site : sites) {
+            for (auto& group : site.breeds) {
+                sort(group.all.begin(), group.all.end());
+                sort(group.vaccinated.begin(), group.vaccinated.end());
+            }
         }
+        buildTree(0, sites.size(), 0);
     }
     
-    const vector<Pet>& getAllPets() const { return pets; }
+    // (distance in km, pet index) of matching pets within radiusKm, nearest first
+    vector<pair<double, size_t>> within(double latitude, double longitude, double radiusKm,
+                                        const PetFilter& filter) const {
+        vector<pair<double, size_t>> result;
+        collectWithin(0, sites.size(), 0, longitude * KM_PER_DEGREE * refLatitudeCos,
+                      latitude * KM_PER_DEGREE, radiusKm, filter, result);
+        sort(result.begin(), result.end());
+        return result;
+    }
     
-    // Application operations
-    void createApplication(const string& username, const string& petName) {
-        applications.emplace_back(nextAppID++, username, petName);
-        saveApplicationsToFile(); // Save when a new application is created
+    // (distance in km, pet index) of the k nearest matching pets, nearest first
+    vector<pair<double, size_t>> nearest(double latitude, double longitude, size_t k,
+                                         const PetFilter& filter) const {
+        vector<pair<double, size_t>> heap;
+        if (k == 0) return heap;
+        collectNearest(0, sites.size(), 0, longitude * KM_PER_DEGREE * refLatitudeCos,
+                       latitude * KM_PER_DEGREE, k, filter, heap);
+        sort_heap(heap.begin(), heap.end());
+        for (auto& entry : heap) entry.first = sqrt(entry.first);
+        return heap;
     }
+};
+
+// Item-item collaborative filtering over the user x pet application matrix.
+// Co-application counts are updated as applications arrive and each pet keeps
+// a precomputed list of its most similar pets (cosine similarity). Pets are
+// keyed by ID, so renames and reused names keep their histories apart.
+class PetRecommender {
+private:
+    static const size_t MAX_NEIGHBORS = 20;
+    unordered_map<string, unordered_set<int>> petsByUser;         // sparse rows of pet IDs
+    unordered_map<int, int> applicantCount;                       // column norms
+    unordered_map<int, unordered_map<int, int>> coApplied;        // pet -> pet -> users
+    unordered_map<int, vector<pair<int, double>>> neighbors;      // pet -> top similar pets
     
-    void processApplication(size_t index, bool approve) {
-        if (index >= applications.size()) {
-            throw out_of_range("Invalid application index");
+    void refreshNeighbors(int petID) {
+        vector<pair<int, double>>& list = neighbors[petID];
+        list.clear();
+        auto row = coApplied.find(petID);
+        if (row == coApplied.end()) return;
+        
+        double norm = applicantCount[petID];
+        for (const auto& entry : row->second) {
+            double sim = entry.second / sqrt(norm * applicantCount[entry.first]);
+            list.emplace_back(entry.first, sim);
+        }
+        auto bySimilarity = [](const pair<int, double>& a, const pair<int, double>& b) {
+            return a.second > b.second;
+        };
+        if (list.size() > MAX_NEIGHBORS) {
+            partial_sort(list.begin(), list.begin() + MAX_NEIGHBORS, list.end(), bySimilarity);
+            list.resize(MAX_NEIGHBORS);
+        } else {
+            sort(list.begin(), list.end(), bySimilarity);
         }
+    }
+    
+public:
+    // Record that a user applied for a pet. With refresh=false only the counts
+    // are updated; call rebuildNeighbors() once afterwards (used at load time).
+    void recordApplication(const string& username, int petID, bool refresh = true) {
+        unordered_set<int>& applied = petsByUser[username];
+        if (!applied.insert(petID).second) return;
         
-        if (approve) {
-            applications[index].approve();
-            for (auto& pet : pets) {
-                if (pet.getName() == applications[index].getPetName()) {
-                    pet.markAsAdopted();
-                    savePetsToFile(); // Save pet status change
-                    break;
+        applicantCount[petID]++;
+        for (int other : applied) {
+            if (other == petID) continue;
+            coApplied[petID][other]++;
+            coApplied[other][petID]++;
+        }
+        
+        if (refresh) {
+            // The pet's norm changed, so every pet it co-occurs with needs a refresh
+            refreshNeighbors(petID);
+            for (const auto& entry : coApplied[petID]) {
+                refreshNeighbors(entry.first);
+            }
+        }
+    }
+    
+    void rebuildNeighbors() {
+        neighbors.clear();
+        for (const auto& row : coApplied) {
+            refreshNeighbors(row.first);
+        }
+    }
+    
+    void clear() {
+        petsByUser.clear();
+        applicantCount.clear();
+        coApplied.clear();
+        neighbors.clear();
+    }
+    
+    // Top-k pet IDs for a user among the pets accept(petID) allows.
+    // Falls back to the most applied-for pets when the user has no history.
+    template <typename Accept>
+    vector<int> recommend(const string& username, size_t k, Accept accept) const {
+        unordered_map<int, double> scores;
+        auto history = petsByUser.find(username);
+        if (history != petsByUser.end()) {
+            for (int petID : history->second) {
+                auto list = neighbors.find(petID);
+                if (list == neighbors.end()) continue;
+                for (const auto& neighbor : list->second) {
+                    if (!history->second.count(neighbor.first)) {
+                        scores[neighbor.first] += neighbor.second;
+                    }
+                }
+            }
+        }
+        if (scores.empty()) {
+            for (const auto& entry : applicantCount) {
+                if (history == petsByUser.end() || !history->second.count(entry.first)) {
+                    scores[entry.first] = entry.second;
                 }
             }
-        } else {
-            applications[index].reject();
         }
         
-        // Save applications to file
-        saveApplicationsToFile();
+        vector<pair<int, double>> ranked;
+        for (const auto& entry : scores) {
+            if (accept(entry.first)) {
+                ranked.push_back(entry);
+            }
+        }
+        size_t count = min(k, ranked.size());
+        partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+                     [](const pair<int, double>& a, const pair<int, double>& b) {
+                         return a.second > b.second;
+                     });
+        
+        vector<int> result;
+        for (size_t i = 0; i < count; ++i) {
+            result.push_back(ranked[i].first);
+        }
+        return result;
+    }
+};
+
+// Stable 64-bit string hash for sketches saved to disk, where std::hash
+// could differ between builds: FNV-1a followed by the MurmurHash3 finalizer
+inline uint64_t stableHash(const string& text) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
     }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// HyperLogLog distinct counter with 2^10 registers, about 3% standard error.
+// Small sets are kept sparse as (register, rank) pairs and switch to the
+// 1 KB register array once that is smaller.
+class HyperLogLog {
+private:
+    static const int PRECISION = 10;
+    static const uint32_t REGISTERS = 1u << PRECISION;
+    static const size_t MAX_SPARSE = REGISTERS / 4;
     
-    const vector<Application>& getAllApplications() const { return applications; }
+    vector<uint16_t> sparse;    // register << 6 | rank, one entry per register
+    vector<uint8_t> dense;      // empty while sparse
     
-    // Search operations
-    vector<Pet> searchPets(unique_ptr<SearchStrategy> strategy) const {
-        return strategy->search(pets);
+    void toDense() {
+        dense.assign(REGISTERS, 0);
+        for (uint16_t entry : sparse) dense[entry >> 6] = entry & 63;
+        vector<uint16_t>().swap(sparse);
     }
     
-    // User management
-    void addUser(unique_ptr<User> user) {
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+    
+public:
+    void add(uint64_t hash) {
+        uint32_t index = static_cast<uint32_t>(hash >> (64 - PRECISION));
+        uint64_t rest = hash << PRECISION;
+        uint8_t rank = 1;
+        while (rank <= 64 - PRECISION && !(rest & (1ull << 63))) {
+            rest <<= 1;
+            rank++;
+        }
+        if (!dense.empty()) {
+            if (dense[index] < rank) dense[index] = rank;
+            return;
+        }
+        // The sparse list is bounded by MAX_SPARSE, so the scan is too
+        for (auto& entry : sparse) {
+            if (static_cast<uint32_t>(entry >> 6) != index) continue;
+            if ((entry & 63) < rank) entry = static_cast<uint16_t>(index << 6 | rank);
+            return;
+        }
+        sparse.push_back(static_cast<uint16_t>(index << 6 | rank));
+        if (sparse.size() > MAX_SPARSE) toDense();
+    }
+    
+    double estimate() const {
+        const double m = REGISTERS;
+        if (dense.empty()) {
+            // Linear counting is exact enough while most registers are empty
+            return sparse.empty() ? 0.0 : m * log(m / (m - sparse.size()));
+        }
+        double sum = 0.0;
+        uint32_t zeros = 0;
+        for (uint8_t rank : dense) {
+            sum += ldexp(1.0, -rank);
+            if (rank == 0) zeros++;
+        }
+        double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+        if (estimate <= 2.5 * m && zeros > 0) estimate = m * log(m / zeros);
+        return estimate;
+    }
+    
+    // "S" and four hex digits per sparse entry, or "D" and two per register
+    string encode() const {
+        static const char hex[] = "0123456789abcdef";
+        string out(1, dense.empty() ? 'S' : 'D');
+        if (dense.empty()) {
+            for (uint16_t entry : sparse) {
+                for (int shift = 12; shift >= 0; shift -= 4) out += hex[(entry >> shift) & 0xf];
+            }
+        } else {
+            for (uint8_t rank : dense) {
+                out += hex[rank >> 4];
+                out += hex[rank & 0xf];
+            }
+        }
+        return out;
+    }
+    
+    bool decode(const string& text) {
+        sparse.clear();
+        dense.clear();
+        if (text.empty()) return false;
+        size_t width = text[0] == 'S' ? 4 : 2;
+        if ((text[0] != 'S' && text[0] != 'D') || (text.size() - 1) % width != 0) return false;
+        if (text[0] == 'D' && text.size() - 1 != REGISTERS * 2) return false;
+        for (size_t i = 1; i < text.size(); i += width) {
+            uint32_t value = 0;
+            for (size_t j = 0; j < width; ++j) {
+                int digit = hexValue(text[i + j]);
+                if (digit < 0) return false;
+                value = value << 4 | digit;
+            }
+            if (text[0] == 'S') sparse.push_back(static_cast<uint16_t>(value));
+            else dense.push_back(static_cast<uint8_t>(value));
+        }
+        return sparse.size() <= MAX_SPARSE;
+    }
+};
+
+// Space-Saving heavy hitters: a fixed number of counters follow the most
+// frequent keys. A counter overestimates its key's frequency by at most its
+// error, and every key seen more than total / capacity times has a counter.
+class SpaceSaving {
+public:
+    struct Counter {
+        string key;
+        uint64_t count;
+        uint64_t error;
+    };
+    
+private:
+    size_t capacity;
+    vector<Counter> counters;
+    unordered_map<string, size_t> slots;    // key -> index into counters
+    uint64_t total = 0;
+    
+public:
+    explicit SpaceSaving(size_t counterCount) : capacity(counterCount) {}
+    
+    void add(const string& key, uint64_t count = 1, uint64_t error = 0) {
+        total += count;
+        auto found = slots.find(key);
+        if (found != slots.end()) {
+            counters[found->second].count += count;
+            return;
+        }
+        if (counters.size() < capacity) {
+            slots[key] = counters.size();
+            counters.push_back(Counter{key, count, error});
+            return;
+        }
+        // Take over the smallest counter; the scan is bounded by the capacity
+        size_t smallest = 0;
+        for (size_t i = 1; i < counters.size(); ++i) {
+            if (counters[i].count < counters[smallest].count) smallest = i;
+        }
+        Counter& counter = counters[smallest];
+        slots.erase(counter.key);
+        slots[key] = smallest;
+        counter.key = key;
+        counter.error = counter.count;
+        counter.count += count;
+    }
+    
+    vector<Counter> top(size_t k) const {
+        vector<Counter> result(counters);
+        sort(result.begin(), result.end(), [](const Counter& a, const Counter& b) {
+            return a.count != b.count ? a.count > b.count : a.key < b.key;
+        });
+        if (result.size() > k) result.resize(k);
+        return result;
+    }
+    
+    const vector<Counter>& all() const { return counters; }
+    uint64_t getTotal() const { return total; }
+    void setTotal(uint64_t value) { total = value; }
+    
+    void clear() {
+        counters.clear();
+        slots.clear();
+        total = 0;
+    }
+};
+
+// Streaming popularity metrics over submitted applications: the most
+// requested breeds and the distinct applicants per pet and per breed. Each
+// application costs O(1) to record; no per-application history is kept.
+class ApplicationSketches {
+public:
+    static const size_t BREED_COUNTERS = 64;
+    
+private:
+    SpaceSaving breeds;
+    unordered_map<string, HyperLogLog> applicantsByPet;
+    unordered_map<string, HyperLogLog> applicantsByBreed;
+    
+public:
+    ApplicationSketches() : breeds(BREED_COUNTERS) {}
+    
+    // breed is empty when the pet is unknown
+    void record(const string& username, const string& petName, const string& breed) {
+        uint64_t hash = stableHash(username);
+        applicantsByPet[petName].add(hash);
+        if (breed.empty()) return;
+        breeds.add(breed);
+        applicantsByBreed[breed].add(hash);
+    }
+    
+    vector<SpaceSaving::Counter> topBreeds(size_t k) const { return breeds.top(k); }
+    uint64_t breedApplications() const { return breeds.getTotal(); }
+    
+    double distinctApplicants(const string& petName) const {
+        auto found = applicantsByPet.find(petName);
+        return found == applicantsByPet.end() ? 0.0 : found->second.estimate();
+    }
+    
+    double distinctBreedApplicants(const string& breed) const {
+        auto found = applicantsByBreed.find(breed);
+        return found == applicantsByBreed.end() ? 0.0 : found->second.estimate();
+    }
+    
+    // Pets with the most distinct applicants, by estimate
+    vector<pair<string, double>> topPets(size_t k) const {
+        vector<pair<string, double>> result;
+        result.reserve(applicantsByPet.size());
+        for (const auto& entry : applicantsByPet) result.emplace_back(entry.first, entry.second.estimate());
+        auto byEstimate = [](const pair<string, double>& a, const pair<string, double>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        };
+        if (result.size() > k) {
+            partial_sort(result.begin(), result.begin() + k, result.end(), byEstimate);
+            result.resize(k);
+        } else {
+            sort(result.begin(), result.end(), byEstimate);
+        }
+        return result;
+    }
+    
+    void clear() {
+        breeds.clear();
+        applicantsByPet.clear();
+        applicantsByBreed.clear();
+    }
+    
+    // Lines: "T,total", "H,count,error,breed", "P,registers,pet" and
+    // "B,registers,breed"; names come last as they are free text
+    void save(ostream& out) const {
+        out << "T," << breeds.getTotal() << "\n";
+        for (const auto& counter : breeds.all()) {
+            out << "H," << counter.count << "," << counter.error << "," << counter.key << "\n";
+        }
+        for (const auto& entry : applicantsByPet) out << "P," << entry.second.encode() << "," << entry.first << "\n";
+        for (const auto& entry : applicantsByBreed) out << "B," << entry.second.encode() << "," << entry.first << "\n";
+    }
+    
+    // Returns false, leaving the sketches empty, if the data is invalid
+    bool load(istream& in) {
+        clear();
+        uint64_t total = 0;
+        string line;
+        while (getline(in, line)) {
+            size_t pos1 = line.find(',');
+            size_t pos2 = pos1 == string::npos ? pos1 : line.find(',', pos1 + 1);
+            bool valid = pos1 == 1;
+            if (valid && line[0] == 'T') {
+                valid = parseText(line.data() + 2, line.data() + line.size(), total);
+            } else if (valid && line[0] == 'H') {
+                size_t pos3 = pos2 == string::npos ? pos2 : line.find(',', pos2 + 1);
+                uint64_t count, error;
+                valid = pos3 != string::npos && parseText(line.data() + 2, line.data() + pos2, count) &&
+                        parseText(line.data() + pos2 + 1, line.data() + pos3, error) &&
+                        breeds.all().size() < BREED_COUNTERS;
+                if (valid) breeds.add(line.substr(pos3 + 1), count, error);
+            } else if (valid && (line[0] == 'P' || line[0] == 'B') && pos2 != string::npos) {
+                auto& sketches = line[0] == 'P' ? applicantsByPet : applicantsByBreed;
+                valid = sketches[line.substr(pos2 + 1)].decode(line.substr(2, pos2 - 2));
+            } else {
+                valid = false;
+            }
+            if (!valid) {
+                clear();
+                return false;
+            }
+        }
+        breeds.setTotal(total);
+        return true;
+    }
+};
+
+// Blocked Bloom filter for fast negative key lookups. Each key maps to one
+// 64-byte block (a cache line) and sets one bit in each of its eight 64-bit
+// words, so a probe touches a single cache line; the eight lanes use fixed
+// salts and no branches so the compiler can vectorize them. Sized at 16 bits
+// per expected key, which gives well under 1% false positives.
+class BlockedBloomFilter {
+private:
+    static const size_t BITS_PER_KEY = 16;
+    static const size_t MIN_KEYS = 1024;
+    
+    struct alignas(64) Block {
+        uint64_t words[8];
+    };
+    
+    vector<Block> blocks;
+    size_t capacity = 0;    // keys the filter was sized for
+    size_t count = 0;       // keys inserted, including since-removed ones
+    
+    static void masks(uint64_t hash, uint64_t out[8]) {
+        static const uint32_t SALT[8] = {0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+                                         0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u};
+        uint32_t key = static_cast<uint32_t>(hash);
+        for (int i = 0; i < 8; ++i) out[i] = 1ull << ((key * SALT[i]) >> 26);
+    }
+    
+    size_t blockIndex(uint64_t hash) const {
+        return static_cast<size_t>(((hash >> 32) * blocks.size()) >> 32);
+    }
+    
+public:
+    BlockedBloomFilter() { reset(0); }
+    
+    // Empty the filter and size it for the expected number of keys
+    void reset(size_t expectedKeys) {
+        capacity = max(expectedKeys, static_cast<size_t>(MIN_KEYS));
+        blocks.assign((capacity * BITS_PER_KEY + 511) / 512, Block());
+        count = 0;
+    }
+    
+    void insert(uint64_t hash) {
+        uint64_t bits[8];
+        masks(hash, bits);
+        Block& block = blocks[blockIndex(hash)];
+        for (int i = 0; i < 8; ++i) block.words[i] |= bits[i];
+        count++;
+    }
+    
+    // False means the key was never inserted
+    bool mayContain(uint64_t hash) const {
+        uint64_t bits[8];
+        masks(hash, bits);
+        const Block& block = blocks[blockIndex(hash)];
+        uint64_t missing = 0;
+        for (int i = 0; i < 8; ++i) missing |= bits[i] & ~block.words[i];
+        return missing == 0;
+    }
+    
+    // Past capacity the false-positive rate climbs; the owner rebuilds
+    bool isFull() const { return count > capacity; }
+    
+    void save(ostream& out) const {
+        uint64_t header[3] = {capacity, count, blocks.size()};
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(Block));
+    }
+    
+    bool load(istream& in) {
+        uint64_t header[3];
+        if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] > (1ull << 32) ||
+            header[2] != (header[0] * BITS_PER_KEY + 511) / 512) {
+            return false;
+        }
+        vector<Block> loaded(header[2]);
+        if (!in.read(reinterpret_cast<char*>(loaded.data()), loaded.size() * sizeof(Block))) return false;
+        blocks.swap(loaded);
+        capacity = header[0];
+        count = header[1];
+        return true;
+    }
+};
+
+// Weight-balanced binary search tree with subtree sizes, giving O(log n)
+// rank-to-key (select) and key-to-rank lookups. Nodes live in one vector and
+// link by position; freed nodes are reused. A node is rebalanced by one or two
+// rotations when one side outweighs the other by more than DELTA (Adams'
+// parameters), so a sorted build needs no rotations at all. Equal keys are
+// allowed and kept in insertion order.
+template <typename Key, typename Less = less<Key>>
+class OrderStatisticTree {
+private:
+    static const size_t DELTA = 3;
+    static const size_t GAMMA = 2;
+    
+    struct Node {
+        Key key;
+        int left;
+        int right;
+        size_t size;
+    };
+    
+    vector<Node> nodes;
+    vector<int> freeNodes;
+    int root = -1;
+    Less keyLess;
+    
+    size_t sizeOf(int node) const { return node < 0 ? 0 : nodes[node].size; }
+    
+    void update(int node) {
+        nodes[node].size = sizeOf(nodes[node].left) + sizeOf(nodes[node].right) + 1;
+    }
+    
+    int rotateLeft(int node) {
+        int right = nodes[node].right;
+        nodes[node].right = nodes[right].left;
+        nodes[right].left = node;
+        update(node);
+        update(right);
+        return right;
+    }
+    
+    int rotateRight(int node) {
+        int left = nodes[node].left;
+        nodes[node].left = nodes[left].right;
+        nodes[left].right = node;
+        update(node);
+        update(left);
+        return left;
+    }
+    
+    // Weights are subtree sizes plus one
+    bool balanced(int light, int heavy) const {
+        return DELTA * (sizeOf(light) + 1) >= sizeOf(heavy) + 1;
+    }
+    
+    int balance(int node) {
+        int left = nodes[node].left;
+        int right = nodes[node].right;
+        if (!balanced(left, right)) {
+            if (sizeOf(nodes[right].left) + 1 >= GAMMA * (sizeOf(nodes[right].right) + 1)) {
+                nodes[node].right = rotateRight(right);
+            }
+            return rotateLeft(node);
+        }
+        if (!balanced(right, left)) {
+            if (sizeOf(nodes[left].right) + 1 >= GAMMA * (sizeOf(nodes[left].left) + 1)) {
+                nodes[node].left = rotateLeft(left);
+            }
+            return rotateRight(node);
+        }
+        update(node);
+        return node;
+    }
+    
+    int insertAt(int node, int added) {
+        if (node < 0) return added;
+        if (keyLess(nodes[added].key, nodes[node].key)) {
+            int left = insertAt(nodes[node].left, added);
+            nodes[node].left = left;
+        } else {
+            int right = insertAt(nodes[node].right, added);
+            nodes[node].right = right;
+        }
+        return balance(node);
+    }
+    
+    // Detach the leftmost node of a subtree into min
+    int removeMin(int node, int& min) {
+        if (nodes[node].left < 0) {
+            min = node;
+            return nodes[node].right;
+        }
+        nodes[node].left = removeMin(nodes[node].left, min);
+        return balance(node);
+    }
+    
+    int eraseAt(int node, const Key& key, bool& erased) {
+        if (node < 0) return node;
+        if (keyLess(key, nodes[node].key)) {
+            nodes[node].left = eraseAt(nodes[node].left, key, erased);
+        } else if (keyLess(nodes[node].key, key)) {
+            nodes[node].right = eraseAt(nodes[node].right, key, erased);
+        } else {
+            erased = true;
+            freeNodes.push_back(node);
+            int left = nodes[node].left;
+            int right = nodes[node].right;
+            if (left < 0) return right;
+            if (right < 0) return left;
+            int successor;
+            right = removeMin(right, successor);
+            nodes[successor].left = left;
+            nodes[successor].right = right;
+            return balance(successor);
+        }
+        return balance(node);
+    }
+    
+    int buildRange(vector<Key>& keys, size_t begin, size_t end) {
+        if (begin == end) return -1;
+        size_t mid = begin + (end - begin) / 2;
+        int node = static_cast<int>(nodes.size());
+        nodes.push_back(Node{move(keys[mid]), -1, -1, end - begin});
+        int left = buildRange(keys, begin, mid);
+        int right = buildRange(keys, mid + 1, end);
+        nodes[node].left = left;
+        nodes[node].right = right;
+        return node;
+    }
+    
+public:
+    size_t size() const { return sizeOf(root); }
+    
+    void clear() {
+        nodes.clear();
+        freeNodes.clear();
+        root = -1;
+    }
+    
+    // Replace the contents with keys, which must already be sorted
+    void build(vector<Key> keys) {
+        clear();
+        nodes.reserve(keys.size());
+        root = buildRange(keys, 0, keys.size());
+    }
+    
+    void insert(const Key& key) {
+        int node;
+        if (freeNodes.empty()) {
+            node = static_cast<int>(nodes.size());
+            nodes.push_back(Node{key, -1, -1, 1});
+        } else {
+            node = freeNodes.back();
+            freeNodes.pop_back();
+            nodes[node] = Node{key, -1, -1, 1};
+        }
+        root = insertAt(root, node);
+    }
+    
+    // Removes one copy of key; false if there was none
+    bool erase(const Key& key) {
+        bool erased = false;
+        root = eraseAt(root, key, erased);
+        return erased;
+    }
+    
+    // Number of keys ordered before key
+    size_t rank(const Key& key) const {
+        size_t before = 0;
+        int node = root;
+        while (node >= 0) {
+            if (keyLess(nodes[node].key, key)) {
+                before += sizeOf(nodes[node].left) + 1;
+                node = nodes[node].right;
+            } else {
+                node = nodes[node].left;
+            }
+        }
+        return before;
+    }
+    
+    // Number of keys ordered before key or equal to it
+    size_t upperRank(const Key& key) const {
+        size_t before = 0;
+        int node = root;
+        while (node >= 0) {
+            if (!keyLess(key, nodes[node].key)) {
+                before += sizeOf(nodes[node].left) + 1;
+                node = nodes[node].right;
+            } else {
+                node = nodes[node].left;
+            }
+        }
+        return before;
+    }
+    
+    // Key at a rank below size()
+    const Key& select(size_t position) const {
+        int node = root;
+        while (true) {
+            size_t leftSize = sizeOf(nodes[node].left);
+            if (position < leftSize) {
+                node = nodes[node].left;
+            } else if (position == leftSize) {
+                return nodes[node].key;
+            } else {
+                position -= leftSize + 1;
+                node = nodes[node].right;
+            }
+        }
+    }
+    
+    // Visit up to count keys in order, starting at rank first
+    template <typename Visitor>
+    void forEach(size_t first, size_t count, Visitor visit) const {
+        vector<int> path;   // nodes still to visit, nearest last
+        int node = root;
+        while (node >= 0) {
+            size_t leftSize = sizeOf(nodes[node].left);
+            if (first < leftSize) {
+                path.push_back(node);
+                node = nodes[node].left;
+            } else if (first == leftSize) {
+                path.push_back(node);
+                break;
+            } else {
+                first -= leftSize + 1;
+                node = nodes[node].right;
+            }
+        }
+        while (count > 0 && !path.empty()) {
+            node = path.back();
+            path.pop_back();
+            visit(nodes[node].key);
+            count--;
+            for (node = nodes[node].right; node >= 0; node = nodes[node].left) path.push_back(node);
+        }
+    }
+};
+
+// Content-based similarity: each pet is encoded as a small fixed-size feature
+// vector (breed words, age, vaccination) and compared with a
+// Euclidean k-nearest-neighbour search. The distance kernel works on fixed-width
+// float rows so the compiler can vectorize it; large catalogues are searched
+// through a vantage-point tree instead of a linear scan.
+const size_t FEATURE_DIMS = 16;
+const size_t BREED_DIMS = 14;
+
+struct alignas(64) PetFeatures {
+    float values[FEATURE_DIMS];
+};
+
+inline float squaredDistance(const PetFeatures& a, const PetFeatures& b) {
+    float sum = 0.0f;
+    for (size_t d = 0; d < FEATURE_DIMS; ++d) {
+        float diff = a.values[d] - b.values[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+class SimilarPetFinder {
+private:
+    static const size_t VP_TREE_THRESHOLD = 2048;
+    
+    struct VPNode {
+        size_t point;       // row in features
+        float radius;       // median distance to the vantage point
+        int inside = -1;    // child with distance <= radius
+        int outside = -1;   // child with distance > radius
+    };
+    
+    vector<PetFeatures> features;   // one row per indexed pet
+    vector<size_t> petIndices;      // row -> index into the pet list
+    unordered_map<string, size_t> vocabulary;   // breed word -> dimension
+    vector<VPNode> nodes;
+    int root = -1;
+    
+    int buildTree(vector<size_t>& rows, size_t begin, size_t end) {
+        if (begin == end) return -1;
+        VPNode node;
+        node.point = rows[begin];
+        node.radius = 0.0f;
+        size_t mid = (begin + 1 + end) / 2;
+        if (end - begin > 1) {
+            const PetFeatures& vantage = features[node.point];
+            nth_element(rows.begin() + begin + 1, rows.begin() + mid, rows.begin() + end,
+                        [&](size_t a, size_t b) {
+                            return squaredDistance(vantage, features[a]) <
+                                   squaredDistance(vantage, features[b]);
+                        });
+            node.radius = sqrt(squaredDistance(vantage, features[rows[mid]]));
+        }
+        int index = static_cast<int>(nodes.size());
+        nodes.push_back(node);
+        int inside = buildTree(rows, begin + 1, mid);
+        int outside = buildTree(rows, mid, end);
+        nodes[index].inside = inside;
+        nodes[index].outside = outside;
+        return index;
+    }
+    
+    // Max-heap of (distance, row) holding the best k candidates so far
+    typedef vector<pair<float, size_t>> Heap;
+    
+    static void offer(Heap& heap, size_t k, float dist, size_t row) {
+        if (heap.size() < k) {
+            heap.emplace_back(dist, row);
+            push_heap(heap.begin(), heap.end());
+        } else if (dist < heap.front().first) {
+            pop_heap(heap.begin(), heap.end());
+            heap.back() = make_pair(dist, row);
+            push_heap(heap.begin(), heap.end());
+        }
+    }
+    
+    void searchTree(int nodeIndex, const PetFeatures& query, size_t k,
+                    size_t excludePet, Heap& heap) const {
+        if (nodeIndex < 0) return;
+        const VPNode& node = nodes[nodeIndex];
+        float dist = sqrt(squaredDistance(query, features[node.point]));
+        if (petIndices[node.point] != excludePet) {
+            offer(heap, k, dist, node.point);
+        }
+        
+        float tau = heap.size() < k ? numeric_limits<float>::max() : heap.front().first;
+        if (dist <= node.radius) {
+            searchTree(node.inside, query, k, excludePet, heap);
+            tau = heap.size() < k ? numeric_limits<float>::max() : heap.front().first;
+            if (dist + tau >= node.radius) searchTree(node.outside, query, k, excludePet, heap);
+        } else {
+            searchTree(node.outside, query, k, excludePet, heap);
+            tau = heap.size() < k ? numeric_limits<float>::max() : heap.front().first;
+            if (dist - tau <= node.radius) searchTree(node.inside, query, k, excludePet, heap);
+        }
+    }
+    
+public:
+    static vector<string> breedWords(const string& breed) {
+        vector<string> words;
+        string word;
+        for (char c : breed + " ") {
+            if (!isspace(static_cast<unsigned char>(c))) {
+                word.push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
+            } else if (!word.empty()) {
+                words.push_back(word);
+                word.clear();
+            }
+        }
+        return words;
+    }
+    
+    PetFeatures encode(const Pet& pet) const {
+        PetFeatures f = {};
+        // One-hot over breed words, so breeds sharing a word ("Labrador",
+        // "Labrador Retriever") end up close. The most common words own a
+        // dimension; rarer ones are hashed into the same space.
+        for (const auto& word : breedWords(pet.getBreed())) {
+            auto dim = vocabulary.find(word);
+            f.values[dim != vocabulary.end() ? dim->second
+                                             : hash<string>()(word) % BREED_DIMS] += 1.0f;
+        }
+        float norm = 0.0f;
+        for (size_t d = 0; d < BREED_DIMS; ++d) norm += f.values[d] * f.values[d];
+        if (norm > 0.0f) {
+            float scale = 2.0f / sqrt(norm);   // breed weighs more than age
+            for (size_t d = 0; d < BREED_DIMS; ++d) f.values[d] *= scale;
+        }
+        // Age in decades, counted back from 1970: only differences between
+        // pets matter, and those stay the same as every pet gets older
+        f.values[BREED_DIMS] = pet.getBirthDate().days / -3652.5f;
+        f.values[BREED_DIMS + 1] = pet.isVaccinated() ? 0.5f : 0.0f;
+        return f;
+    }
+    
+    // Index the available (not adopted) pets
+    void build(const PetTable& pets) {
+        features.clear();
+        petIndices.clear();
+        nodes.clear();
+        root = -1;
+        
+        unordered_map<string, size_t> wordCounts;
+        for (const auto& pet : pets) {
+            for (const auto& word : breedWords(pet.getBreed())) wordCounts[word]++;
+        }
+        vector<pair<size_t, string>> byFrequency;
+        for (const auto& entry : wordCounts) {
+            byFrequency.emplace_back(entry.second, entry.first);
+        }
+        sort(byFrequency.rbegin(), byFrequency.rend());
+        vocabulary.clear();
+        for (size_t d = 0; d < byFrequency.size() && d < BREED_DIMS; ++d) {
+            vocabulary[byFrequency[d].second] = d;
+        }
+        
+        for (size_t i = 0; i < pets.size(); ++i) {
+            if (!pets[i].isAdopted()) {
+                features.push_back(encode(pets[i]));
+                petIndices.push_back(i);
+            }
+        }
+        if (features.size() >= VP_TREE_THRESHOLD) {
+            vector<size_t> rows(features.size());
+            for (size_t i = 0; i < rows.size(); ++i) rows[i] = i;
+            nodes.reserve(rows.size());
+            root = buildTree(rows, 0, rows.size());
+        }
+    }
+    
+    // Pet indices of the k indexed pets closest to the query, nearest first
+    vector<size_t> findSimilar(const Pet& query, size_t k, size_t excludePet) const {
+        PetFeatures q = encode(query);
+        Heap heap;
+        if (root >= 0) {
+            searchTree(root, q, k, excludePet, heap);
+        } else {
+            vector<float> dist(features.size());
+            for (size_t row = 0; row < features.size(); ++row) {
+                dist[row] = squaredDistance(q, features[row]);
+            }
+            for (size_t row = 0; row < features.size(); ++row) {
+                if (petIndices[row] != excludePet) offer(heap, k, dist[row], row);
+            }
+        }
+        sort_heap(heap.begin(), heap.end());
+        vector<size_t> result;
+        for (const auto& entry : heap) {
+            result.push_back(petIndices[entry.second]);
+        }
+        return result;
+    }
+};
+
+// SHA-256 digest of data as 64 lowercase hex characters
+string sha256Hex(const string& data) {
+    static const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+    uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+    
+    string message = data;
+    uint64_t bitLength = static_cast<uint64_t>(data.size()) * 8;
+    message.push_back(static_cast<char>(0x80));
+    while (message.size() % 64 != 56) message.push_back('\0');
+    for (int i = 7; i >= 0; --i) message.push_back(static_cast<char>(bitLength >> (i * 8)));
+    
+    for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            const unsigned char* b = reinterpret_cast<const unsigned char*>(&message[chunk + i * 4]);
+            w[i] = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+            uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+            w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+    
+    ostringstream hex;
+    for (int i = 0; i < 8; ++i) hex << std::hex << setw(8) << setfill('0') << h[i];
+    return hex.str();
+}
+
+// Content-addressed photo store. Blobs are named by their SHA-256, stored once
+// however many pets reference them, and appended to large segment files so
+// saving a photo never rewrites pets.dat. Pets reference their photos by pet
+// ID, so a rename keeps them and a new pet with a deleted pet's name starts
+// without any. Unreferenced blobs are dropped by collectGarbage(), which
+// also compacts segments that are mostly garbage.
+class PhotoStore {
+private:
+    static const uint64_t SEGMENT_LIMIT = 64ull * 1024 * 1024;
+    
+    struct BlobLocation {
+        int segment;
+        uint64_t offset;
+        uint64_t length;
+    };
+    
+    string directory;
+    map<string, BlobLocation> blobs;            // hash -> location
+    map<int, vector<string>> petPhotos;         // pet ID -> photo hashes
+    map<string, vector<string>> legacyPhotos;   // pet name -> photo hashes, from older refs.dat
+    int activeSegment = 1;
+    
+    string segmentPath(int segment) const {
+        return directory + "/segment-" + to_string(segment) + ".pack";
+    }
+    
+    uint64_t segmentSize(int segment) const {
+        ifstream in(segmentPath(segment), ios::binary | ios::ate);
+        return in.is_open() ? static_cast<uint64_t>(in.tellg()) : 0;
+    }
+    
+    BlobLocation append(const string& bytes) {
+        uint64_t size = segmentSize(activeSegment);
+        if (size > 0 && size + bytes.size() > SEGMENT_LIMIT) {
+            activeSegment++;
+            size = 0;
+        }
+        ofstream out(segmentPath(activeSegment), ios::binary | ios::app);
+        if (!out.is_open()) {
+            throw FileOperationException("Failed to open photo segment for writing");
+        }
+        out.write(bytes.data(), bytes.size());
+        BlobLocation location = { activeSegment, size, bytes.size() };
+        return location;
+    }
+    
+    void saveIndex() const {
+        ofstream out(directory + "/index.dat");
+        if (!out.is_open()) {
+            throw FileOperationException("Failed to open photo index for writing");
+        }
+        for (const auto& blob : blobs) {
+            out << blob.first << "," << blob.second.segment << ","
+                << blob.second.offset << "," << blob.second.length << "\n";
+        }
+        ofstream refs(directory + "/refs.dat");
+        if (!refs.is_open()) {
+            throw FileOperationException("Failed to open photo references for writing");
+        }
+        refs << "SCHEMA:2\n";
+        for (const auto& pet : petPhotos) {
+            for (const auto& hash : pet.second) refs << pet.first << "," << hash << "\n";
+        }
+        out.close();
+        refs.close();
+        if (!out || !refs) {
+            throw FileOperationException("Failed to write photo index");
+        }
+    }
+    
+public:
+    void open(const string& dir) {
+        directory = dir;
+        makeDirectory(directory);
+        blobs.clear();
+        petPhotos.clear();
+        legacyPhotos.clear();
+        activeSegment = 1;
+        
+        string line;
+        ifstream index(directory + "/index.dat");
+        while (getline(index, line)) {
+            size_t pos1 = line.find(',');
+            size_t pos2 = line.find(',', pos1+1);
+            size_t pos3 = line.find(',', pos2+1);
+            if (pos1 == string::npos || pos2 == string::npos || pos3 == string::npos) continue;
+            BlobLocation location = { stoi(line.substr(pos1+1, pos2-pos1-1)),
+                                      stoull(line.substr(pos2+1, pos3-pos2-1)),
+                                      stoull(line.substr(pos3+1)) };
+            blobs[line.substr(0, pos1)] = location;
+            activeSegment = max(activeSegment, location.segment);
+        }
+        // refs.dat without a schema line names the pets instead of giving
+        // their IDs; see assignLegacyPhotos()
+        ifstream refs(directory + "/refs.dat");
+        bool byID = getline(refs, line) && line == "SCHEMA:2";
+        if (!byID) {
+            refs.clear();
+            refs.seekg(0, ios::beg);
+        }
+        while (getline(refs, line)) {
+            size_t pos = line.rfind(',');
+            if (pos == string::npos) continue;
+            if (byID) petPhotos[stoi(line.substr(0, pos))].push_back(line.substr(pos+1));
+            else legacyPhotos[line.substr(0, pos)].push_back(line.substr(pos+1));
+        }
+    }
+    
+    // Give photos referenced by name in an older refs.dat to the pets with
+    // that name (every one of them, as they shared the photos before) and
+    // reclaim the photos of names no pet has
+    void assignLegacyPhotos(const PetTable& pets) {
+        if (legacyPhotos.empty()) return;
+        for (const auto& pet : pets) {
+            auto it = legacyPhotos.find(pet.getName());
+            if (it != legacyPhotos.end()) petPhotos[pet.getID()] = it->second;
+        }
+        legacyPhotos.clear();
+        collectGarbage();
+    }
+    
+    // Store a photo for a pet; identical content is stored only once
+    string addPhoto(int petID, const string& bytes) {
+        string hash = sha256Hex(bytes);
+        if (!blobs.count(hash)) {
+            blobs[hash] = append(bytes);
+        }
+        vector<string>& photos = petPhotos[petID];
+        if (find(photos.begin(), photos.end(), hash) == photos.end()) {
+            photos.push_back(hash);
+        }
+        saveIndex();
+        return hash;
+    }
+    
+    vector<string> getPhotos(int petID) const {
+        auto it = petPhotos.find(petID);
+        return it == petPhotos.end() ? vector<string>() : it->second;
+    }
+    
+    // Drop a pet's references and reclaim blobs nothing points to any more
+    void removePet(int petID) {
+        if (petPhotos.erase(petID)) {
+            collectGarbage();
+        }
+    }
+    
+    void collectGarbage() {
+        set<string> live;
+        for (const auto& pet : petPhotos) live.insert(pet.second.begin(), pet.second.end());
+        
+        map<int, uint64_t> liveBytes;
+        for (auto it = blobs.begin(); it != blobs.end(); ) {
+            if (!live.count(it->first)) {
+                it = blobs.erase(it);
+            } else {
+                liveBytes[it->second.segment] += it->second.length;
+                ++it;
+            }
+        }
+        
+        // Compact segments that are more than half garbage. The old segments
+        // are removed only once the index points at the copies, so a crash
+        // part-way leaves every photo readable.
+        int lastSegment = activeSegment;
+        vector<int> compacted;
+        for (int segment = 1; segment <= lastSegment; ++segment) {
+            uint64_t total = segmentSize(segment);
+            if (total == 0 || liveBytes[segment] * 2 >= total) continue;
+            if (segment == activeSegment) activeSegment++;
+            for (auto& blob : blobs) {
+                if (blob.second.segment != segment) continue;
+                blob.second = append(readPhoto(blob.first));
+            }
+            compacted.push_back(segment);
+        }
+        saveIndex();
+        for (int segment : compacted) remove(segmentPath(segment).c_str());
+    }
+    
+    string readPhoto(const string& hash) const {
+        auto it = blobs.find(hash);
+        if (it == blobs.end()) {
+            throw InvalidInputException("Unknown photo " + hash);
+        }
+        const BlobLocation& location = it->second;
+        ifstream in(segmentPath(location.segment), ios::binary);
+        string bytes(location.length, '\0');
+        in.seekg(location.offset);
+        if (!in.read(&bytes[0], location.length)) {
+            throw FileOperationException("Failed to read photo " + hash);
+        }
+        return bytes;
+    }
+    
+    // Write a photo to an open file descriptor (file or socket) without copying
+    // it through user space where the platform allows it
+    void servePhoto(const string& hash, int outFd) const {
+        auto it = blobs.find(hash);
+        if (it == blobs.end()) {
+            throw InvalidInputException("Unknown photo " + hash);
+        }
+        #ifdef __linux__
+        const BlobLocation& location = it->second;
+        int inFd = ::open(segmentPath(location.segment).c_str(), O_RDONLY);
+        if (inFd < 0) {
+            throw FileOperationException("Failed to open photo segment");
+        }
+        off_t offset = static_cast<off_t>(location.offset);
+        uint64_t remaining = location.length;
+        while (remaining > 0) {
+            ssize_t sent = sendfile(outFd, inFd, &offset, remaining);
+            if (sent <= 0) {
+                close(inFd);
+                throw FileOperationException("Failed to send photo " + hash);
+            }
+            remaining -= sent;
+        }
+        close(inFd);
+        #elif !defined(_WIN32)
+        const BlobLocation& location = it->second;
+        int inFd = ::open(segmentPath(location.segment).c_str(), O_RDONLY);
+        if (inFd < 0) {
+            throw FileOperationException("Failed to open photo segment");
+        }
+        // Map the pages holding the blob and write them straight from the page cache
+        long page = sysconf(_SC_PAGESIZE);
+        off_t mapStart = static_cast<off_t>(location.offset - location.offset % page);
+        size_t mapLength = location.length + (location.offset - mapStart);
+        void* mapped = mmap(nullptr, mapLength, PROT_READ, MAP_SHARED, inFd, mapStart);
+        close(inFd);
+        if (mapped == MAP_FAILED) {
+            throw FileOperationException("Failed to map photo " + hash);
+        }
+        const char* data = static_cast<const char*>(mapped) + (location.offset - mapStart);
+        size_t written = 0;
+        while (written < location.length) {
+            ssize_t n = write(outFd, data + written, location.length - written);
+            if (n <= 0) break;
+            written += n;
+        }
+        munmap(mapped, mapLength);
+        if (written < location.length) {
+            throw FileOperationException("Failed to send photo " + hash);
+        }
+        #else
+        (void)outFd;
+        throw FileOperationException("Zero-copy serving is not supported on this platform");
+        #endif
+    }
+    
+    // Copy a photo to a file path
+    void exportPhoto(const string& hash, const string& path) const {
+        #ifdef _WIN32
+        ofstream out(path, ios::binary);
+        string bytes = readPhoto(hash);
+        out.write(bytes.data(), bytes.size());
+        #else
+        int outFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outFd < 0) {
+            throw FileOperationException("Failed to open " + path + " for writing");
+        }
+        try {
+            servePhoto(hash, outFd);
+        } catch (...) {
+            close(outFd);
+            throw;
+        }
+        close(outFd);
+        #endif
+    }
+};
+
+// Inverted index over pet descriptions with BM25 ranking. Postings are
+// delta-encoded varints grouped into blocks of BLOCK_SIZE with skip entries,
+// and top-k queries use WAND so documents that cannot reach the current
+// top-k threshold are skipped without being scored. Documents are pet IDs, so
+// deleting a pet leaves the other postings valid, and pets added after the
+// build are appended to the postings.
+class DescriptionIndex {
+private:
+    static const uint32_t BLOCK_SIZE = 128;
+    static constexpr float K1 = 1.2f;
+    static constexpr float B = 0.75f;
+    
+    struct PostingList {
+        vector<uint8_t> bytes;          // (doc delta, term frequency) varint pairs
+        vector<uint32_t> blockLastDoc;  // skip entries: last doc of each block
+        vector<uint32_t> blockOffset;   // byte offset where each block starts
+        uint32_t count = 0;
+        uint32_t lastDoc = 0;
+        float maxScore = 0.0f;          // upper bound of this term's BM25 contribution
+    };
+    
+    unordered_map<string, PostingList> postings;
+    vector<uint32_t> docLengths;    // by pet ID
+    // Collection statistics from the last build. They stay fixed as pets are
+    // added, so a term's idf only falls as its list grows and every maxScore
+    // remains an upper bound.
+    uint32_t builtDocuments = 0;
+    float averageLength = 0.0f;
+    size_t documents = 0;           // indexed, including those added since the build
+    uint32_t lastDoc = 0;           // highest pet ID indexed
+    
+    static void putVarint(vector<uint8_t>& out, uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+    
+    static uint32_t getVarint(const uint8_t*& p) {
+        uint32_t value = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            value |= static_cast<uint32_t>(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        value |= static_cast<uint32_t>(*p++) << shift;
+        return value;
+    }
+    
+    float idf(const PostingList& list) const {
+        float n = static_cast<float>(builtDocuments);
+        return log(1.0f + (n - list.count + 0.5f) / (list.count + 0.5f));
+    }
+    
+    float termScore(float idfValue, uint32_t tf, uint32_t doc) const {
+        float norm = K1 * (1.0f - B + B * docLengths[doc] / averageLength);
+        return idfValue * tf * (K1 + 1.0f) / (tf + norm);
+    }
+    
+    // Sequential reader over one posting list with block skipping
+    struct Cursor {
+        const PostingList* list;
+        float idf;
+        const uint8_t* p;
+        uint32_t index;     // position of the current posting
+        uint32_t doc;
+        uint32_t tf;
+        
+        explicit Cursor(const PostingList* l, float idfValue)
+            : list(l), idf(idfValue), p(l->bytes.data()), index(0), doc(0), tf(0) {
+            decode(0);
+        }
+        
+        bool done() const { return index >= list->count; }
+        
+        void decode(uint32_t base) {
+            if (done()) return;
+            doc = base + getVarint(p);
+            tf = getVarint(p);
+        }
+        
+        void next() {
+            ++index;
+            decode(doc);
+        }
+        
+        // Advance to the first posting with doc >= target
+        void seek(uint32_t target) {
+            if (done() || doc >= target) return;
+            size_t block = index / BLOCK_SIZE;
+            size_t skipTo = block;
+            while (skipTo + 1 < list->blockLastDoc.size() && list->blockLastDoc[skipTo] < target) {
+                ++skipTo;
+            }
+            if (skipTo != block) {
+                index = static_cast<uint32_t>(skipTo * BLOCK_SIZE);
+                p = list->bytes.data() + list->blockOffset[skipTo];
+                decode(list->blockLastDoc[skipTo - 1]);
+            }
+            while (!done() && doc < target) next();
+        }
+    };
+    
+    // Append a document after every indexed one; returns its length. With
+    // score set, the bounds of its terms are raised to cover it.
+    size_t indexDocument(uint32_t doc, const string& description, bool score) {
+        vector<string> tokens = tokenize(description);
+        if (docLengths.size() <= doc) docLengths.resize(doc + 1, 0);
+        docLengths[doc] = static_cast<uint32_t>(tokens.size());
+        
+        sort(tokens.begin(), tokens.end());
+        for (size_t i = 0; i < tokens.size(); ) {
+            size_t j = i;
+            while (j < tokens.size() && tokens[j] == tokens[i]) ++j;
+            
+            PostingList& list = postings[tokens[i]];
+            if (list.count % BLOCK_SIZE == 0) {
+                list.blockOffset.push_back(static_cast<uint32_t>(list.bytes.size()));
+                list.blockLastDoc.push_back(doc);
+            }
+            putVarint(list.bytes, doc - list.lastDoc);
+            putVarint(list.bytes, static_cast<uint32_t>(j - i));
+            list.blockLastDoc.back() = doc;
+            list.lastDoc = doc;
+            list.count++;
+            if (score) list.maxScore = max(list.maxScore, termScore(idf(list), static_cast<uint32_t>(j - i), doc));
+            i = j;
+        }
+        documents++;
+        lastDoc = doc;
+        return tokens.size();
+    }
+    
+public:
+    static vector<string> tokenize(const string& text) {
+        vector<string> tokens;
+        string token;
+        for (char c : text) {
+            if (isalnum(static_cast<unsigned char>(c))) {
+                token.push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
+            } else if (!token.empty()) {
+                tokens.push_back(token);
+                token.clear();
+            }
+        }
+        if (!token.empty()) tokens.push_back(token);
+        return tokens;
+    }
+    
+    // Index every pet's description, in pet ID order
+    void build(const PetTable& pets) {
+        postings.clear();
+        docLengths.clear();
+        documents = 0;
+        lastDoc = 0;
+        vector<pair<int, size_t>> byID;
+        byID.reserve(pets.size());
+        for (size_t i = 0; i < pets.size(); ++i) byID.push_back(make_pair(pets[i].getID(), i));
+        if (!is_sorted(byID.begin(), byID.end())) sort(byID.begin(), byID.end());
+        
+        uint64_t totalLength = 0;
+        for (const auto& pet : byID) {
+            totalLength += indexDocument(static_cast<uint32_t>(pet.first), pets[pet.second].getDescription(), false);
+        }
+        builtDocuments = static_cast<uint32_t>(pets.size());
+        averageLength = pets.empty() ? 1.0f : max(1.0f, static_cast<float>(totalLength) / pets.size());
+        
+        for (auto& entry : postings) {
+            PostingList& list = entry.second;
+            float idfValue = idf(list);
+            for (Cursor cursor(&list, idfValue); !cursor.done(); cursor.next()) {
+                list.maxScore = max(list.maxScore, termScore(idfValue, cursor.tf, cursor.doc));
+            }
+        }
+    }
+    
+    // Index a pet added since the build. Returns false if its ID is not
+    // above every indexed one, in which case the index needs a rebuild.
+    bool add(const Pet& pet) {
+        uint32_t doc = static_cast<uint32_t>(pet.getID());
+        if (documents > 0 && doc <= lastDoc) return false;
+        indexDocument(doc, pet.getDescription(), true);
+        return true;
+    }
+    
+    // Added pets skew the statistics and deleted ones still take up
+    // postings; either calls for a rebuild once it reaches a quarter of the
+    // pets indexed by the build
+    bool outgrown(size_t livePets) const {
+        size_t slack = builtDocuments / 4 + 64;
+        return documents - builtDocuments > slack || documents > livePets + slack;
+    }
+    
+    // Top-k (score, pet ID) for the query, best first. Documents rejected
+    // by accept are skipped before scoring.
+    template <typename Accept>
+    vector<pair<float, size_t>> search(const string& query, size_t k, Accept accept) const {
+        vector<Cursor> cursors;
+        vector<string> terms = tokenize(query);
+        sort(terms.begin(), terms.end());
+        terms.erase(unique(terms.begin(), terms.end()), terms.end());
+        for (const auto& term : terms) {
+            auto it = postings.find(term);
+            if (it != postings.end()) cursors.emplace_back(&it->second, idf(it->second));
+        }
+        
+        // Min-heap of the best k results so far
+        vector<pair<float, size_t>> heap;
+        auto greater = [](const pair<float, size_t>& a, const pair<float, size_t>& b) {
+            return a.first > b.first;
+        };
+        
+        while (k > 0 && !cursors.empty()) {
+            sort(cursors.begin(), cursors.end(),
+                 [](const Cursor& a, const Cursor& b) { return a.doc < b.doc; });
+            float threshold = heap.size() < k ? 0.0f : heap.front().first;
+            
+            // Pivot: first cursor at which the accumulated upper bounds beat the threshold
+            float bound = 0.0f;
+            size_t pivot = cursors.size();
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                bound += cursors[i].list->maxScore;
+                if (bound > threshold) {
+                    pivot = i;
+                    break;
+                }
+            }
+            if (pivot == cursors.size()) break;
+            
+            uint32_t pivotDoc = cursors[pivot].doc;
+            if (cursors[0].doc == pivotDoc) {
+                bool accepted = accept(pivotDoc);
+                float score = 0.0f;
+                for (auto& cursor : cursors) {
+                    if (cursor.doc != pivotDoc) break;
+                    if (accepted) score += termScore(cursor.idf, cursor.tf, pivotDoc);
+                    cursor.next();
+                }
+                if (accepted && (heap.size() < k || score > threshold)) {
+                    if (heap.size() == k) {
+                        pop_heap(heap.begin(), heap.end(), greater);
+                        heap.pop_back();
+                    }
+                    heap.emplace_back(score, pivotDoc);
+                    push_heap(heap.begin(), heap.end(), greater);
+                }
+            } else {
+                for (size_t i = 0; i < pivot; ++i) cursors[i].seek(pivotDoc);
+            }
+            cursors.erase(remove_if(cursors.begin(), cursors.end(),
+                                    [](const Cursor& c) { return c.done(); }),
+                          cursors.end());
+        }
+        
+        sort(heap.begin(), heap.end(), greater);
+        return heap;
+    }
+};
+
+// User class (Abstract)
+class User {
+protected:
+    string username;
+    string password;
+    Role role;
+public:
+    User(string uname, string pwd, Role r) : username(uname), password(pwd), role(r) {}
+    virtual ~User() = default;
+    
+    // Stored fields in file order; passwords are never exported
+    RECORD_FIELD(User, username, "username", 0);
+    RECORD_FIELD(User, password, "password", FIELD_INTERNAL);
+    RECORD_FIELD(User, role, "role", 0);
+    typedef FieldList<usernameField, passwordField, roleField> Fields;
+    
+    // Serialization for file storage
+    string serialize() const {
+        string out;
+        serializeTo(out);
+        return out;
+    }
+    
+    void serializeTo(string& out) const { TextCodec<User>::encode(*this, out); }
+    
+    // Creates an Admin or a RegularUser according to the stored role
+    static unique_ptr<User> deserialize(const string& data);
+    
+    const string& getUsername() const { return username; }
+    string getPassword() const { return password; }
+    Role getRole() const { return role; }
+    void setUsername(const string& uname) { username = uname; }
+    void setPassword(const string& pwd) { password = pwd; }
+    bool hasPassword() const { return !password.empty(); }
+    
+    virtual void showDashboard() = 0;
+    virtual void performAction(PetAdoptionSystem& system) = 0;
+    
+    // Accounts imported without a password cannot log in until an admin sets one
+    bool authenticate(string uname, string pwd) const {
+        return (hasPassword() && username == uname && password == pwd);
+    }
+    
+    friend class PetAdoptionSystem;
+};
+
+// Admin class
+class Admin : public User {
+public:
+    Admin(string uname, string pwd) : User(uname, pwd, Role::ADMIN) {}
+    
+    void showDashboard() override {
+        cout << "\n==== ADMIN DASHBOARD ====\n";
+        cout << "1. Add Another Admin\n";
+        cout << "2. Manage User Accounts\n";
+        cout << "3. Manage Pet Records\n";
+        cout << "4. Process Applications\n";
+        cout << "5. Search Pets\n";
+        cout << "6. Undo / Redo Changes\n";
+        cout << "7. Reports\n";
+        cout << "8. Data Tools\n";
+        cout << "9. Logout\n";
+    }
+    
+    void performAction(PetAdoptionSystem& system) override;
+};
+
+// Regular User class
+class RegularUser : public User {
+public:
+    RegularUser(string uname, string pwd) : User(uname, pwd, Role::USER) {}
+    
+    void showDashboard() override {
+        cout << "\n==== USER DASHBOARD ====\n";
+        cout << "1. Browse Pets\n";
+        cout << "2. Check Application Status\n";
+        cout << "3. View History\n";
+        cout << "4. Recommended for You\n";
+        cout << "5. Find Similar Pets\n";
+        cout << "6. Find Pets Near You\n";
+        cout << "7. Search Descriptions\n";
+        cout << "8. Logout\n";
+    }
+    
+    void performAction(PetAdoptionSystem& system) override;
+};
+
+unique_ptr<User> User::deserialize(const string& data) {
+    RegularUser record("", "");
+    if (!TextCodec<User>::decode(data, record)) {
+        throw InvalidInputException("Invalid user data format");
+    }
+    if (record.role == Role::ADMIN) return unique_ptr<User>(new Admin(record.username, record.password));
+    return unique_ptr<User>(new RegularUser(record.username, record.password));
+}
+
+// A committed version of the tables, identified by its commit timestamp
+struct DataSnapshot {
+    uint64_t timestamp;
+    PetTable pets;
+    ApplicationTable applications;
+};
+
+// Schema versions of the data files, written as a "SCHEMA:<n>" first line.
+// Files without one predate schema headers (schema 0); the loaders still read
+// every older layout, and the SchemaMigrator rewrites older files on startup.
+//   users.dat         1  username,password,role
+//   pets.dat          6  VERSION and NEXT_ID headers; id,name,breed,birth
+//                        date,vaccinated,adopted,shelter,version,description
+//                        (schema 5 and older have no ids, which are assigned
+//                        in file order; schema 4 and older store an age in
+//                        years for the birth date)
+//   applications.dat  4  NEXT_ID and VERSION headers; id,username,pet,status,
+//                        version,submitted,decided,pet id (schema 3 and older
+//                        have no pet id, which the loader finds by pet name;
+//                        0 when the pet is unknown)
+const int USERS_SCHEMA = 1;
+const int PETS_SCHEMA = 6;
+const int APPLICATIONS_SCHEMA = 4;
+
+// Read the schema line of a data file, or rewind and return 0 if it has none
+int readSchemaHeader(istream& in, const string& fileName, int supported) {
+    string line;
+    if (getline(in, line) && line.compare(0, 7, "SCHEMA:") == 0) {
+        int schema = stoi(line.substr(7));
+        if (schema > supported) {
+            throw FileOperationException(fileName + " uses schema " + to_string(schema) +
+                                         "; this program supports up to " + to_string(supported));
+        }
+        return schema;
+    }
+    in.clear();
+    in.seekg(0, ios::beg);
+    return 0;
+}
+
+// Online backup of one shelter. The tables come from a pinned snapshot, so
+// the copy is consistent as of one commit while writers carry on. Files are
+// written by a background thread at a limited rate, then read back and
+// checked against the checksums recorded in the MANIFEST.
+class BackupJob {
+public:
+    enum State { RUNNING, SUCCEEDED, FAILED };
+    
+private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    
+    string targetDir;
+    uint64_t bytesPerSecond;    // 0 for unlimited
+    DataSnapshot snapshot;
+    int nextPetID;
+    int nextAppID;
+    string usersData;
+    string sheltersData;
+    string sketchesData;
+    
+    atomic<int> state;
+    atomic<uint64_t> bytesWritten;
+    string message;             // written before state leaves RUNNING
+    chrono::steady_clock::time_point started;
+    vector<pair<string, pair<uint64_t, uint64_t>>> manifest;   // file -> (size, checksum)
+    thread worker;
+    
+    static uint64_t fnv1a(uint64_t hash, const char* data, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+    
+    // Buffered file writer that checksums and rate-limits what it writes
+    class Writer {
+    private:
+        BackupJob& job;
+        string name;
+        ofstream out;
+        string buffer;
+        uint64_t size = 0;
+        uint64_t checksum = 14695981039346656037ull;
+    public:
+        Writer(BackupJob& j, const string& fileName)
+            : job(j), name(fileName), out(j.targetDir + "/" + fileName, ios::binary) {
+            if (!out.is_open()) {
+                throw FileOperationException("Failed to open backup file " + fileName);
+            }
+        }
+        
+        void write(const string& data) {
+            buffer += data;
+            if (buffer.size() >= CHUNK_SIZE) flushBuffer();
+        }
+        
+        template <typename Record>
+        void writeRecord(const Record& record) {
+            record.serializeTo(buffer);
+            buffer += '\n';
+            if (buffer.size() >= CHUNK_SIZE) flushBuffer();
+        }
+        
+        void flushBuffer() {
+            out.write(buffer.data(), buffer.size());
+            checksum = fnv1a(checksum, buffer.data(), buffer.size());
+            size += buffer.size();
+            job.bytesWritten += buffer.size();
+            buffer.clear();
+            job.throttle();
+        }
+        
+        void close() {
+            flushBuffer();
+            out.close();
+            if (!out) {
+                throw FileOperationException("Failed to write backup file " + name);
+            }
+            job.manifest.push_back(make_pair(name, make_pair(size, checksum)));
+        }
+    };
+    
+    void throttle() {
+        if (bytesPerSecond == 0) return;
+        auto due = started + chrono::microseconds(bytesWritten * 1000000 / bytesPerSecond);
+        this_thread::sleep_until(due);
+    }
+    
+    void verify() const {
+        for (const auto& entry : manifest) {
+            ifstream in(targetDir + "/" + entry.first, ios::binary);
+            uint64_t size = 0;
+            uint64_t checksum = 14695981039346656037ull;
+            char buffer[CHUNK_SIZE];
+            while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+                checksum = fnv1a(checksum, buffer, in.gcount());
+                size += in.gcount();
+            }
+            if (size != entry.second.first || checksum != entry.second.second) {
+                throw FileOperationException("Verification failed for " + entry.first);
+            }
+        }
+    }
+    
+    void run() {
+        try {
+            makeDirectory(targetDir);
+            
+            Writer users(*this, "users.dat");
+            users.write(usersData);
+            users.close();
+            
+            Writer pets(*this, "pets.dat");
+            pets.write("SCHEMA:" + to_string(PETS_SCHEMA) + "\n");
+            pets.write("VERSION:" + to_string(snapshot.timestamp) + "\n");
+            pets.write("NEXT_ID:" + to_string(nextPetID) + "\n");
+            for (const auto& pet : snapshot.pets) pets.writeRecord(pet);
+            pets.close();
+            
+            Writer apps(*this, "applications.dat");
+            apps.write("SCHEMA:" + to_string(APPLICATIONS_SCHEMA) + "\n");
+            apps.write("NEXT_ID:" + to_string(nextAppID) + "\n");
+            apps.write("VERSION:" + to_string(snapshot.timestamp) + "\n");
+            for (const auto& app : snapshot.applications) apps.writeRecord(app);
+            apps.close();
+            
+            Writer shelters(*this, "shelters.dat");
+            shelters.write(sheltersData);
+            shelters.close();
+            
+            Writer sketches(*this, "sketches.dat");
+            sketches.write(sketchesData);
+            sketches.close();
+            
+            verify();
+            
+            // The manifest is written last and marks a complete backup
+            ofstream out(targetDir + "/MANIFEST");
+            out << "VERSION:" << snapshot.timestamp << "\n";
+            for (const auto& entry : manifest) {
+                out << entry.first << "," << entry.second.first << "," << entry.second.second << "\n";
+            }
+            out.close();
+            if (!out) {
+                throw FileOperationException("Failed to write backup manifest");
+            }
+            
+            message = "Backup of version " + to_string(snapshot.timestamp) + " verified (" +
+                      to_string(bytesWritten.load()) + " bytes)";
+            state = SUCCEEDED;
+        } catch (const exception& e) {
+            message = string("Backup failed: ") + e.what();
+            state = FAILED;
+        }
+    }
+    
+public:
+    BackupJob(const string& target, uint64_t rate, const DataSnapshot& data, int nextPet, int nextApp,
+              const string& users, const string& shelters, const string& sketches)
+        : targetDir(target), bytesPerSecond(rate), snapshot(data), nextPetID(nextPet), nextAppID(nextApp),
+          usersData(users), sheltersData(shelters), sketchesData(sketches), state(RUNNING), bytesWritten(0),
+          started(chrono::steady_clock::now()) {
+        worker = thread(&BackupJob::run, this);
+    }
+    
+    ~BackupJob() {
+        if (worker.joinable()) worker.join();
+    }
+    
+    BackupJob(const BackupJob&) = delete;
+    BackupJob& operator=(const BackupJob&) = delete;
+    
+    bool finished() const { return state != RUNNING; }
+    bool succeeded() const { return state == SUCCEEDED; }
+    uint64_t getSnapshotTimestamp() const { return snapshot.timestamp; }
+    
+    void wait() {
+        if (worker.joinable()) worker.join();
+    }
+    
+    string status() const {
+        if (!finished()) {
+            return "Backup of version " + to_string(snapshot.timestamp) + " running, " +
+                   to_string(bytesWritten.load()) + " bytes written";
+        }
+        return message;
+    }
+};
+
+// Version-ordered index of record changes for delta exports. Each key (pet
+// or application ID) is listed once, under the version that last changed it;
+// deleted keys stay behind as tombstones so a delta can report them, until
+// they are pruned.
+class ChangeIndex {
+private:
+    set<pair<uint64_t, string>> byVersion;
+    unordered_map<string, pair<uint64_t, bool>> latest;  // key -> (version, deleted)
+    size_t tombstones = 0;
+    
+public:
+    void record(const string& key, uint64_t version, bool deleted) {
+        auto it = latest.find(key);
+        if (it != latest.end()) {
+            byVersion.erase(make_pair(it->second.first, key));
+            if (it->second.second) tombstones--;
+            it->second = make_pair(version, deleted);
+        } else {
+            latest.insert(make_pair(key, make_pair(version, deleted)));
+        }
+        if (deleted) tombstones++;
+        byVersion.insert(make_pair(version, key));
+    }
+    
+    size_t tombstoneCount() const { return tombstones; }
+    
+    // Forget the tombstones recorded at or before horizon
+    void prune(uint64_t horizon) {
+        for (auto it = byVersion.begin(); it != byVersion.end() && it->first <= horizon;) {
+            auto entry = latest.find(it->second);
+            if (entry->second.second) {
+                latest.erase(entry);
+                it = byVersion.erase(it);
+                tombstones--;
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    // Visit the tombstones, oldest first: visit(key, version)
+    template <typename Visitor>
+    void forEachTombstone(Visitor visit) const {
+        if (tombstones == 0) return;
+        for (const auto& change : byVersion) {
+            if (latest.at(change.second).second) visit(change.second, change.first);
+        }
+    }
+    
+    // Version of a key, or 0 if it was never recorded
+    uint64_t versionOf(const string& key) const {
+        auto it = latest.find(key);
+        return it == latest.end() ? 0 : it->second.first;
+    }
+    
+    // Visit keys changed after the given version, oldest change first:
+    // visit(key, version, deleted)
+    template <typename Visitor>
+    void forEachSince(uint64_t since, Visitor visit) const {
+        if (since == numeric_limits<uint64_t>::max()) return;
+        for (auto it = byVersion.lower_bound(make_pair(since + 1, string()));
+             it != byVersion.end(); ++it) {
+            visit(it->second, it->first, latest.at(it->second).second);
+        }
+    }
+    
+    void clear() {
+        byVersion.clear();
+        latest.clear();
+        tombstones = 0;
+    }
+};
+
+// Background upgrade of legacy data files to the current schemas. Each file is
+// streamed in chunks whose records are converted in parallel, written to
+// <file>.migrating and renamed over the original. Startup does not wait: the
+// loaders read the legacy layout directly. A file the system saves before its
+// migration finishes is already current, so that migration is dropped.
+// Records that cannot be parsed are kept in <file>.rejected.
+class SchemaMigrator {
+private:
+    static const size_t CHUNK_LINES = 64 * 1024;
+    static const size_t MIN_LINES_PER_THREAD = 4096;
+    
+    struct Job {
+        string path;
+        string fileName;
+    };
+    
+    vector<Job> jobs;
+    mutex lock;
+    set<string> saved;          // files saved since their migration started
+    thread worker;
+    atomic<bool> running;
+    string status;              // guarded by lock
+    string problems;            // guarded by lock
+    
+    // Convert one legacy record to the current layout; throws if invalid.
+    // Pets without an id get their record number, as the loader gives them.
+    static string convertRecord(const string& fileName, const string& line, bool hasVersion, bool hasID,
+                                size_t recordNumber) {
+        if (fileName == "pets.dat") {
+            Pet pet = Pet::deserialize(line, hasVersion, hasID);
+            if (!hasID) pet.setID(static_cast<int>(recordNumber));
+            return pet.serialize();
+        }
+        if (fileName == "applications.dat") return Application::deserialize(line).serialize();
+        return User::deserialize(line)->serialize();
+    }
+    
+    static int currentSchema(const string& fileName) {
+        if (fileName == "pets.dat") return PETS_SCHEMA;
+        if (fileName == "applications.dat") return APPLICATIONS_SCHEMA;
+        return USERS_SCHEMA;
+    }
+    
+    // Records of the chunk are numbered from first
+    void convertChunk(const string& fileName, bool hasVersion, bool hasID, size_t first,
+                      const vector<string>& lines, size_t count, vector<string>& output, vector<char>& valid) {
+        unsigned threads = max(1u, thread::hardware_concurrency());
+        threads = static_cast<unsigned>(min<size_t>(threads, max<size_t>(1, count / MIN_LINES_PER_THREAD)));
+        size_t step = (count + threads - 1) / threads;
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            size_t begin = min(count, t * step), end = min(count, begin + step);
+            auto work = [&, begin, end]() {
+                for (size_t i = begin; i < end; ++i) {
+                    try {
+                        output[i] = convertRecord(fileName, lines[i], hasVersion, hasID, first + i);
+                        valid[i] = 1;
+                    } catch (const exception&) {
+                        valid[i] = 0;
+                    }
+                }
+            };
+            if (t + 1 == threads) work();
+            else workers.push_back(thread(work));
+        }
+        for (auto& w : workers) w.join();
+    }
+    
+    void migrate(const Job& job) {
+        ifstream in(job.path, ios::binary);
+        string temp = job.path + ".migrating";
+        ofstream out(temp, ios::binary);
+        if (!in.is_open() || !out.is_open()) {
+            throw FileOperationException("Failed to open " + job.fileName + " for migration");
+        }
+        bool hasID = readSchemaHeader(in, job.fileName, currentSchema(job.fileName)) >= 6;
+        out << "SCHEMA:" << currentSchema(job.fileName) << "\n";
+        
+        // Header lines are copied as they are; a pets.dat with a VERSION
+        // header already stores record versions
+        string line;
+        bool hasVersion = false;
+        bool pending = false;
+        while (getline(in, line)) {
+            if (line.compare(0, 8, "NEXT_ID:") == 0 || line.compare(0, 8, "VERSION:") == 0) {
+                if (line.compare(0, 8, "VERSION:") == 0) hasVersion = true;
+                out << line << "\n";
+            } else {
+                pending = true;
+                break;
+            }
+        }
+        if (job.fileName == "pets.dat" && !hasVersion) out << "VERSION:1\n";
+        
+        ofstream rejected;
+        size_t rejectedCount = 0;
+        vector<string> lines(CHUNK_LINES), output(CHUNK_LINES);
+        vector<char> valid(CHUNK_LINES);
+        size_t count = 0;
+        size_t records = 0;
+        auto writeChunk = [&]() {
+            convertChunk(job.fileName, hasVersion, hasID, records + 1, lines, count, output, valid);
+            records += count;
+            for (size_t i = 0; i < count; ++i) {
+                if (valid[i]) {
+                    out << output[i] << "\n";
+                    continue;
+                }
+                if (!rejected.is_open()) rejected.open(job.path + ".rejected", ios::binary | ios::app);
+                rejected << lines[i] << "\n";
+                rejectedCount++;
+            }
+            count = 0;
+        };
+        while (pending || getline(in, line)) {
+            pending = false;
+            if (line.empty()) continue;
+            lines[count++].swap(line);
+            if (count == CHUNK_LINES) writeChunk();
+        }
+        writeChunk();
+        out.close();
+        if (!out) {
+            remove(temp.c_str());
+            throw FileOperationException("Failed to write migrated " + job.fileName);
+        }
+        
+        lock_guard<mutex> guard(lock);
+        if (saved.count(job.fileName)) {
+            remove(temp.c_str());   // the system already wrote the current schema
+            return;
+        }
+        #ifdef _WIN32
+        remove(job.path.c_str());
+        #endif
+        if (rename(temp.c_str(), job.path.c_str()) != 0) {
+            remove(temp.c_str());
+            throw FileOperationException("Failed to replace " + job.fileName);
+        }
+        if (rejectedCount > 0) {
+            problems += job.fileName + ": " + to_string(rejectedCount) + " unreadable record(s) kept in " +
+                      job.fileName + ".rejected. ";
+        }
+    }
+    
+    void run() {
+        for (const auto& job : jobs) {
+            try {
+                migrate(job);
+            } catch (const exception& e) {
+                lock_guard<mutex> guard(lock);
+                problems += string("Migration of ") + job.fileName + " failed: " + e.what() + ". ";
+            }
+        }
+        lock_guard<mutex> guard(lock);
+        status = "Migrated " + to_string(jobs.size()) + " legacy file(s). " + problems;
+        running = false;
+    }
+    
+public:
+    SchemaMigrator() : running(false) {}
+    
+    ~SchemaMigrator() { wait(); }
+    
+    // Queue every data file in dataDir with an older schema, then start
+    // converting them on a background thread
+    void start(const string& dataDir) {
+        const char* files[] = {"users.dat", "pets.dat", "applications.dat"};
+        for (const char* fileName : files) {
+            ifstream in(dataDir + "/" + fileName);
+            if (!in.is_open()) continue;
+            if (readSchemaHeader(in, fileName, currentSchema(fileName)) < currentSchema(fileName)) {
+                Job job = { dataDir + "/" + fileName, fileName };
+                jobs.push_back(job);
+            }
+        }
+        if (jobs.empty()) return;
+        status = "Migrating " + to_string(jobs.size()) + " legacy file(s)...";
+        running = true;
+        worker = thread(&SchemaMigrator::run, this);
+    }
+    
+    // Called before the system writes a file in the current schema
+    void markSaved(const string& fileName) {
+        lock_guard<mutex> guard(lock);
+        saved.insert(fileName);
+    }
+    
+    bool isRunning() const { return running; }
+    
+    void wait() {
+        if (worker.joinable()) worker.join();
+    }
+    
+    string getStatus() {
+        lock_guard<mutex> guard(lock);
+        return status;
+    }
+};
+
+// Tables persisted by a PetAdoptionSystem, used as dirty flags
+enum DataTable {
+    USERS_TABLE = 1,
+    PETS_TABLE = 2,
+    APPLICATIONS_TABLE = 4,
+    SHELTERS_TABLE = 8
+};
+
+// Sort orders of the paged pet listings
+enum PetOrder { PETS_BY_NAME, PETS_BY_AGE };
+
+// PetAdoptionSystem: one shelter's data set, stored in its own data directory.
+// Instances are owned by the ShelterRegistry.
+class PetAdoptionSystem {
+private:
+    string dataDirectory;
+    unsigned dirtyTables = 0;
+    size_t pendingChanges = 0;
+    size_t flushBatchSize = 1;  // 1 writes every change through immediately
+    size_t reportMemoryLimit = 64 << 20;    // working memory for sorts and aggregations
+    vector<unique_ptr<User>> users;
+    PetTable pets;
+    ApplicationTable applications;
+    vector<Shelter> shelters;
+    int nextPetID = 1;      // never reused, even when an added pet is undone
+    int nextAppID = 1;
+    int nextShelterID = 1;
+    // (username, pet name) of every application that is not rejected
+    unordered_set<pair<string, string>, ApplicationKeyHash> activeApplications;
+    PetRecommender recommender;
+    ApplicationSketches sketches;   // saved to sketches.dat when changed
+    bool sketchesDirty = false;
+    // Filters over usernames and pet names rule out most missing keys without
+    // a scan. Between rebuilds they only gain keys; they are rebuilt when the
+    // table is saved in full, when they fill up and when undo swaps the pets.
+    BlockedBloomFilter userFilter;
+    BlockedBloomFilter petFilter;
+    bool filtersDirty = false;      // saved to filters.dat on flush
+    SimilarPetFinder similarPets;
+    bool similarPetsStale = true;
+    PetLocator petLocator;
+    bool petLocatorStale = true;
+    // Availability is checked at query time, so only description edits and
+    // undo make the description index stale
+    DescriptionIndex descriptionIndex;
+    bool descriptionIndexStale = true;
+    PhotoStore photoStore;
+    
+    // Undo history for admin changes. Each entry is an O(1) snapshot of the
+    // tables taken before the change; the redo history holds the states that
+    // were undone.
+    struct TableVersion {
+        string action;
+        PetTable pets;
+        ApplicationTable applications;
+        int nextAppID;
+        int deletedPet = 0;                 // ID of the pet removed by this change, if any
+    };
+    static const size_t MAX_UNDO = 50;
+    static const size_t PETS_PER_PAGE = 20;
+    vector<TableVersion> undoHistory;
+    vector<TableVersion> redoHistory;
+    
+    // Multi-version concurrency for readers: every change commits a new
+    // version with a timestamp. Versions are retained only while a reader
+    // with an older or equal snapshot is active.
+    uint64_t commitClock = 0;
+    map<uint64_t, DataSnapshot> retainedVersions;
+    multiset<uint64_t> pinnedVersions;
+    
+    unique_ptr<BackupJob> backupJob;
+    string lastBackupStatus;
+    
+    // Last-modified version of every pet and application by ID, ordered by
+    // version for delta exports. Deletions are kept as tombstones and
+    // appended to tombstones.dat on flush.
+    ChangeIndex petChanges;
+    ChangeIndex applicationChanges;
+    vector<string> pendingTombstones;
+    // Tombstones are kept until they fall DELTA_RETENTION versions behind,
+    // but never past the oldest pinned snapshot; deltas must then start
+    // after the horizon. tombstones.dat is rewritten without them once it
+    // has doubled since the last rewrite.
+    static const uint64_t DELTA_RETENTION = 100000;
+    static const size_t MIN_TOMBSTONES_BEFORE_PRUNING = 1024;
+    uint64_t deltaHorizon = 0;
+    size_t storedTombstones = 0;        // records in tombstones.dat
+    size_t keptTombstones = 0;          // records left by the last rewrite
+    bool tombstonesOutdated = false;    // tombstones.dat needs a rewrite
+    unordered_map<int, size_t> petPositions;    // pet ID -> index
+    bool petPositionsStale = true;
+    // Pets in listing order, kept up to date as pets are added, edited and
+    // deleted and rebuilt after loads and undo. Keys end in the pet ID, so
+    // pets that share a name each keep their own entry. The age order is by
+    // birth date, so it stays valid as pets grow older.
+    typedef pair<string, int> PetNameKey;
+    typedef pair<int32_t, PetNameKey> PetAgeKey;
+    OrderStatisticTree<PetNameKey> petsByName;
+    OrderStatisticTree<PetAgeKey> petsByAge;
+    bool petOrderStale = true;
+    
+    // Pet edits store only the changed fields. They are appended to
+    // pet_edits.dat on flush instead of rewriting pets.dat, which compacts
+    // them away once the journal passes an eighth of the table.
+    static const size_t MIN_PET_EDITS_BEFORE_COMPACTION = 1024;
+    vector<string> pendingPetEdits;
+    size_t journaledPetEdits = 0;   // records in pet_edits.dat
+    
+    SchemaMigrator migrator;
+    
+    void collectOldVersions() {
+        if (pinnedVersions.empty()) {
+            retainedVersions.clear();
+            return;
+        }
+        retainedVersions.erase(retainedVersions.begin(),
+                               retainedVersions.lower_bound(*pinnedVersions.begin()));
+    }
+    
+bool validateYesNo(const string& input) {
+    if (input != "Y" && input != "y") {
+        cout << "Invalid input. Please input only Y or y.\n";
+        return false;
+    }
+    return true;
+}
+    
+    
+    
+    string dataPath(const string& fileName) const {
+        return dataDirectory + "/" + fileName;
+    }
+    
+    // Record a change to the given tables and flush once the batch is full
+    void markDirty(unsigned tables) {
+        commitClock++;
+        if (!pinnedVersions.empty()) {
+            DataSnapshot version = { commitClock, pets, applications };
+            retainedVersions.insert(make_pair(commitClock, version));
+        }
+        dirtyTables |= tables;
+        if (++pendingChanges >= flushBatchSize) {
+            flush();
+        }
+    }
+    
+    // Private constructor, instances are created by the ShelterRegistry
+    explicit PetAdoptionSystem(const string& dataDir) : dataDirectory(dataDir) {
+        makeDirectory(dataDirectory);
+        photoStore.open(dataPath("photos"));
+        
+        loadUsersFromFile();
+        if (users.empty()) {
+            users.push_back(unique_ptr<User>(new Admin("admin", "admin123")));
+            saveUsersToFile();
+        }
+        
+        loadPetsFromFile();
+        // Add default pets only if no pets were loaded
+        if (pets.empty()) {
+            appendPet(Pet("Whiskers", "Siamese", Date::today().monthsBefore(24), true));
+            appendPet(Pet("Rex", "Labrador", Date::today().monthsBefore(36), true));
+            savePetsToFile();
+        }
+        photoStore.assignLegacyPhotos(pets);
+        
+        loadApplicationsFromFile();
+        loadSketchesFromFile();
+        loadSheltersFromFile();
+        rebuildChangeIndex();
+        loadFiltersFromFile();
+        // Legacy files were read as they are; upgrade them in the background
+        migrator.start(dataDirectory);
+    }
+    
+    // File handling functions
+    void saveUsersToFile();
+    void loadUsersFromFile();
+    void savePetsToFile();
+    void loadPetsFromFile();
+    void saveApplicationsToFile();
+    void loadApplicationsFromFile();
+    void saveSheltersToFile();
+    void loadSheltersFromFile();
+    void saveTombstonesToFile();
+    void saveSketchesToFile();
+    void loadSketchesFromFile();
+    void saveFiltersToFile();
+    void loadFiltersFromFile();
+    void savePetEditsToFile();
+    void loadPetEditsFromFile(uint64_t savedVersion);
+    void rebuildApplicationIndex();
+    void rebuildChangeIndex();
+    
+    // Version the next markDirty() commits; changed records are stamped with it
+    uint64_t nextVersion() const { return commitClock + 1; }
+    
+    void stampPet(size_t index) {
+        pets.mutableAt(index).setVersion(nextVersion());
+        petChanges.record(to_string(pets[index].getID()), nextVersion(), false);
+    }
+    
+    void stampApplication(size_t index) {
+        applications.mutableAt(index).setVersion(nextVersion());
+        applicationChanges.record(to_string(applications[index].getID()), nextVersion(), false);
+    }
+    
+    // filters.dat only matches the users and pets files it was saved with,
+    // and users.dat has no version to check it against. It is removed before
+    // either table is written and saved again at the end of the flush, so a
+    // crash in between leaves no filters that could miss a name.
+    void discardSavedFilters() {
+        remove(dataPath("filters.dat").c_str());
+        filtersDirty = true;
+    }
+    
+    void rebuildUserFilter() {
+        userFilter.reset(users.size() * 2);
+        for (const auto& user : users) userFilter.insert(stableHash(user->getUsername()));
+        filtersDirty = true;
+    }
+    
+    void rebuildPetFilter() {
+        petFilter.reset(pets.size() * 2);
+        for (const auto& pet : pets) petFilter.insert(stableHash(pet.getName()));
+        filtersDirty = true;
+    }
+    
+    // Call after the user is in the table, so a rebuild includes it
+    void rememberUsername(const string& username) {
+        if (userFilter.isFull()) rebuildUserFilter();
+        userFilter.insert(stableHash(username));
+        filtersDirty = true;
+    }
+    
+    static PetNameKey nameKey(const Pet& pet) {
+        return make_pair(pet.getName(), pet.getID());
+    }
+    
+    // Youngest first: later birth dates sort earlier
+    static PetAgeKey ageKey(const Pet& pet) {
+        return make_pair(-pet.getBirthDate().days, nameKey(pet));
+    }
+    
+    void rebuildPetOrder() {
+        vector<PetNameKey> names;
+        vector<PetAgeKey> ages;
+        names.reserve(pets.size());
+        ages.reserve(pets.size());
+        for (const auto& pet : pets) {
+            names.push_back(nameKey(pet));
+            ages.push_back(ageKey(pet));
+        }
+        sort(names.begin(), names.end());
+        sort(ages.begin(), ages.end());
+        petsByName.build(move(names));
+        petsByAge.build(move(ages));
+        petOrderStale = false;
+    }
+    
+    void addToPetOrder(const Pet& pet) {
+        if (petOrderStale) return;
+        petsByName.insert(nameKey(pet));
+        petsByAge.insert(ageKey(pet));
+    }
+    
+    void removeFromPetOrder(const Pet& pet) {
+        if (petOrderStale) return;
+        petsByName.erase(nameKey(pet));
+        petsByAge.erase(ageKey(pet));
+    }
+    
+    void rememberPetName(const string& name) {
+        if (petFilter.isFull()) rebuildPetFilter();
+        petFilter.insert(stableHash(name));
+        filtersDirty = true;
+    }
+    
+    void recordInSketches(const Application& app) {
+        size_t pet = findPet(app.getPetName());
+        sketches.record(app.getUsername(), app.getPetName(), pet == pets.size() ? string() : pets[pet].getBreed());
+        sketchesDirty = true;
+    }
+    
+    void recordDeletion(ChangeIndex& changes, char table, const string& key) {
+        changes.record(key, nextVersion(), true);
+        pendingTombstones.push_back(string(1, table) + "," + to_string(nextVersion()) + "," + key);
+    }
+    
+    // True if two records differ at most in their version
+    template <typename Record>
+    static bool sameContent(const Record& a, const Record& b) {
+        return RecordEquality<Record>::equal(a, b, FIELD_VERSION);
+    }
+    
+    // After an undo/redo, keep the versions of records that did not change,
+    // stamp the ones that did and record tombstones for the ones that vanished
+    void stampSwitchedTables(const PetTable& oldPets, const ApplicationTable& oldApplications) {
+        unordered_map<int, const Pet*> previousPets;
+        for (const auto& pet : oldPets) previousPets[pet.getID()] = &pet;
+        for (size_t i = 0; i < pets.size(); ++i) {
+            auto previous = previousPets.find(pets[i].getID());
+            if (previous == previousPets.end()) {
+                stampPet(i);
+                continue;
+            }
+            if (!sameContent(pets[i], *previous->second)) {
+                stampPet(i);
+            } else if (pets[i].getVersion() != previous->second->getVersion()) {
+                pets.mutableAt(i).setVersion(previous->second->getVersion());
+            }
+            previousPets.erase(previous);
+        }
+        for (const auto& gone : previousPets) recordDeletion(petChanges, 'P', to_string(gone.first));
+        
+        unordered_map<int, const Application*> previousApplications;
+        for (const auto& app : oldApplications) previousApplications[app.getID()] = &app;
+        for (size_t i = 0; i < applications.size(); ++i) {
+            auto previous = previousApplications.find(applications[i].getID());
+            if (previous == previousApplications.end()) {
+                stampApplication(i);
+                continue;
+            }
+            if (!sameContent(applications[i], *previous->second)) {
+                stampApplication(i);
+            } else if (applications[i].getVersion() != previous->second->getVersion()) {
+                applications.mutableAt(i).setVersion(previous->second->getVersion());
+            }
+            previousApplications.erase(previous);
+        }
+        for (const auto& gone : previousApplications) {
+            recordDeletion(applicationChanges, 'A', to_string(gone.first));
+        }
+    }
+    
+    const unordered_map<int, size_t>& getPetPositions() {
+        if (petPositionsStale) {
+            petPositions.clear();
+            for (size_t i = 0; i < pets.size(); ++i) petPositions[pets[i].getID()] = i;
+            petPositionsStale = false;
+        }
+        return petPositions;
+    }
+    
+    // Index of the first pet, in ID order, with the given name, or
+    // pets.size() if there is none
+    size_t findPet(const string& name) {
+        if (petOrderStale) rebuildPetOrder();
+        size_t rank = petsByName.rank(make_pair(name, numeric_limits<int>::min()));
+        if (rank == petsByName.size() || petsByName.select(rank).first != name) return pets.size();
+        return getPetPositions().at(petsByName.select(rank).second);
+    }
+    
+    // Assigns the pet its ID and appends it to the table; returns its index
+    size_t appendPet(Pet pet) {
+        pet.setID(nextPetID++);
+        pets.push_back(pet);
+        if (!petPositionsStale) petPositions[pet.getID()] = pets.size() - 1;
+        return pets.size() - 1;
+    }
+    
+    // Applications are kept in ID order; returns applications.size() if absent
+    size_t findApplication(int id) const {
+        size_t low = 0, high = applications.size();
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (applications[mid].getID() < id) low = mid + 1;
+            else high = mid;
+        }
+        if (low < applications.size() && applications[low].getID() == id) return low;
+        return applications.size();
+    }
+    
+    TableVersion& recordUndo(const string& action) {
+        TableVersion version;
+        version.action = action;
+        version.pets = pets;
+        version.applications = applications;
+        version.nextAppID = nextAppID;
+        undoHistory.push_back(version);
+        if (undoHistory.size() > MAX_UNDO) {
+            releaseVersion(undoHistory.front());
+            undoHistory.erase(undoHistory.begin());
+        }
+        for (const auto& undone : redoHistory) releaseVersion(undone);
+        redoHistory.clear();
+        return undoHistory.back();
+    }
+    
+    // Called when a history entry is dropped: a deletion that can no longer be
+    // undone releases the pet's photos
+    void releaseVersion(const TableVersion& version) {
+        if (version.deletedPet == 0 || getPetPositions().count(version.deletedPet)) return;
+        photoStore.removePet(version.deletedPet);
+    }
+    
+    // Swap in a version from one history, saving the current state in the other
+    string switchVersion(vector<TableVersion>& from, vector<TableVersion>& to) {
+        if (from.empty()) return "";
+        TableVersion target = from.back();
+        from.pop_back();
+        
+        TableVersion current = target;
+        current.pets = pets;
+        current.applications = applications;
+        current.nextAppID = nextAppID;
+        to.push_back(current);
+        
+        bool applicationsChanged = !applications.sameVersion(target.applications);
+        pets = target.pets;
+        applications = target.applications;
+        nextAppID = target.nextAppID;
+        stampSwitchedTables(current.pets, current.applications);
+        rebuildPetFilter();
+        petOrderStale = true;
+        petPositionsStale = true;
+        descriptionIndexStale = true;
+        onPetsChanged();
+        if (applicationsChanged) rebuildApplicationIndex();
+        markDirty(PETS_TABLE | APPLICATIONS_TABLE);
+        return target.action;
+    }
+    
+    // Mark indexes derived from the pet list as out of date. Positions only
+    // move when pets are removed or the table is swapped, which mark them
+    // stale themselves.
+    void onPetsChanged() {
+        similarPetsStale = true;
+        petLocatorStale = true;
+    }
+    
+    void indexDescription(size_t index) {
+        if (!descriptionIndexStale && !descriptionIndex.add(pets[index])) descriptionIndexStale = true;
+    }
+    
+    const PetLocator& getPetLocator() {
+        if (petLocatorStale) {
+            petLocator.build(pets, shelters);
+            petLocatorStale = false;
+        }
+        return petLocator;
+    }
+    
+    // Helper functions
+    void clearScreen() const {
+        system("cls || clear");
+    }
+    
+    string getHiddenInput(const string& prompt) const {
+        string input;
+        cout << prompt;
+        
+        #ifdef _WIN32
+        // Windows implementation
+        char ch;
+        while ((ch = _getch()) != '\r') {
+            if (ch == '\b') {
+                if (!input.empty()) {
+                    cout << "\b \b";
+                    input.pop_back();
+                }
+            } else {
+                cout << '*';
+                input.push_back(ch);
+            }
+        }
+        #else
+        // Unix/Linux/macOS implementation using termios directly
+        termios oldt, newt;
+        tcgetattr(STDIN_FILENO, &oldt);
+        newt = oldt;
+        newt.c_lflag &= ~(ECHO | ICANON);
+        tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+        
+        char ch;
+        while ((ch = getchar()) != '\n') {
+            if (ch == 127 || ch == 8) { // Backspace or Delete
+                if (!input.empty()) {
+                    cout << "\b \b";
+                    input.pop_back();
+                }
+            } else {
+                cout << '*';
+                input.push_back(ch);
+            }
+        }
+        
+        // Restore terminal settings
+        tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+        #endif
+        
+        cout << endl;
+        return input;
+    }
+    
+    string getValidatedInput(const string& prompt, bool (*validator)(const string&), 
+                           const string& errorMsg, int maxAttempts = 3) const {
+        string input;
+        int attempts = 0;
+        while (attempts < maxAttempts) {
+            cout << prompt;
+            getline(cin >> ws, input);
+            if (input == "0") return input;
+            if (validator(input)) {
+                return input;
+            }
+            cout << errorMsg << " (" << maxAttempts - attempts - 1
+                 << " attempts remaining, or '0' to cancel)\n";
+            attempts++;
+        }
+        throw InvalidInputException("Too many failed attempts");
+    }
+    
+    int getNumericInput(const string& prompt, int min, int max, int maxAttempts = 3) const {
+        int value;
+        int attempts = 0;
+        string input;
+        
+        while (attempts < maxAttempts) {
+            cout << prompt;
+            getline(cin, input);
+            
+            if (!regex_match(input, regex("^\\s*\\d+\\s*$"))) {
+                cout << "Invalid input format. Please enter a whole number between " 
+                     << min << " and " << max << ".\n";
+                attempts++;
+                continue;
+            }
+            
+            try {
+                value = stoi(input);
+                if (value >= min && value <= max) {
+                    return value;
+                }
+                cout << "Please enter between " << min << " and " << max
+                     << " (" << maxAttempts - attempts - 1 << " attempts left)\n";
+            } catch (...) {
+                cout << "Invalid input. Please enter a number between "
+                     << min << " and " << max << ".\n";
+            }
+            attempts++;
+        }
+        throw InvalidInputException("Too many failed attempts");
+    }
+    
+    double getDecimalInput(const string& prompt, double min, double max, int maxAttempts = 3) const {
+        int attempts = 0;
+        string input;
+        
+        while (attempts < maxAttempts) {
+            cout << prompt;
+            getline(cin, input);
+            
+            if (regex_match(input, regex("^\\s*-?\\d+(\\.\\d+)?\\s*$"))) {
+                double value = stod(input);
+                if (value >= min && value <= max) {
+                    return value;
+                }
+            }
+            cout << "Please enter a number between " << min << " and " << max
+                 << " (" << maxAttempts - attempts - 1 << " attempts left)\n";
+            attempts++;
+        }
+        throw InvalidInputException("Too many failed attempts");
+    }
+    
+    Date getAgeInput(const string& prompt) const {
+        string input;
+        Date birthDate;
+        while (true) {
+            cout << prompt;
+            getline(cin, input);
+            if (parseAgeText(input, birthDate)) return birthDate;
+            cout << "Invalid age format. Please enter like '2', '3 years', '6 months' or '2021-06-30'\n";
+        }
+    }
+
+public:
+    // Delete copy constructor and assignment operator
+    PetAdoptionSystem(const PetAdoptionSystem&) = delete;
+    PetAdoptionSystem& operator=(const PetAdoptionSystem&) = delete;
+    
+    // The default shelter's system (data files in the working directory)
+    static PetAdoptionSystem& getInstance();
+    
+    // Destructor
+    ~PetAdoptionSystem() {
+        try {
+            if (backupJob) backupJob->wait();
+            migrator.wait();
+            clearUndoHistory();
+            flush();
+        } catch (const exception& e) {
+            cerr << "Error saving data: " << e.what() << "\n";
+        }
+    }
+    
+    const string& getDataDirectory() const { return dataDirectory; }
+    
+    // Flush scheduling: persist after every n changes (1 = write-through)
+    void setFlushBatchSize(size_t n) {
+        flushBatchSize = max<size_t>(n, 1);
+        if (pendingChanges >= flushBatchSize) flush();
+    }
+    
+    // Memory budget for report sorts and aggregations; larger inputs spill
+    // temporary runs into the tmp folder of the data directory
+    void setReportMemoryLimit(size_t bytes) { reportMemoryLimit = max<size_t>(bytes, 1 << 16); }
+    size_t getReportMemoryLimit() const { return reportMemoryLimit; }
+    string getTempDirectory() const { return dataPath("tmp"); }
+    
+    // Progress of the background upgrade of legacy data files
+    bool isMigrating() const { return migrator.isRunning(); }
+    string getMigrationStatus() { return migrator.getStatus(); }
+    void waitForMigration() { migrator.wait(); }
+    
+    // Write every table changed since the last flush
+    void flush() {
+        if (!pendingPetEdits.empty() && !(dirtyTables & PETS_TABLE)) {
+            if (journaledPetEdits + pendingPetEdits.size() >
+                max(static_cast<size_t>(MIN_PET_EDITS_BEFORE_COMPACTION), pets.size() / 8)) {
+                dirtyTables |= PETS_TABLE;
+            } else {
+                savePetEditsToFile();
+            }
+        }
+        if (dirtyTables & USERS_TABLE) saveUsersToFile();
+        if (dirtyTables & PETS_TABLE) savePetsToFile();
+        if (dirtyTables & APPLICATIONS_TABLE) saveApplicationsToFile();
+        if (dirtyTables & SHELTERS_TABLE) saveSheltersToFile();
+        if (!pendingTombstones.empty() || tombstonesOutdated) saveTombstonesToFile();
+        if (sketchesDirty) saveSketchesToFile();
+        if (filtersDirty) saveFiltersToFile();
+        dirtyTables = 0;
+        pendingChanges = 0;
+    }
+    
+    // Main system operations
+    void run();
+    void registerUser(Role role);
+    User* login(Role role);
+    
+    // Undo/redo of admin changes; each returns the action name or "" if none
+    string undo() { return switchVersion(undoHistory, redoHistory); }
+    string redo() { return switchVersion(redoHistory, undoHistory); }
+    
+    string peekUndo() const { return undoHistory.empty() ? "" : undoHistory.back().action; }
+    string peekRedo() const { return redoHistory.empty() ? "" : redoHistory.back().action; }
+    
+    void clearUndoHistory() {
+        vector<TableVersion> dropped;
+        dropped.swap(undoHistory);
+        dropped.insert(dropped.end(), redoHistory.begin(), redoHistory.end());
+        redoHistory.clear();
+        for (const auto& version : dropped) releaseVersion(version);
+    }
+    
+    // O(1) consistent snapshots for readers such as reports
+    PetTable snapshotPets() const { return pets; }
+    ApplicationTable snapshotApplications() const { return applications; }
+    
+    uint64_t getCommitTimestamp() const { return commitClock; }
+    
+    // Pin the latest version, or a retained older one, for a reader. Writers
+    // keep committing new versions while the snapshot is pinned.
+    DataSnapshot pinSnapshot() {
+        return pinSnapshot(commitClock);
+    }
+    
+    DataSnapshot pinSnapshot(uint64_t timestamp) {
+        if (timestamp == commitClock) {
+            DataSnapshot latest = { commitClock, pets, applications };
+            retainedVersions.insert(make_pair(commitClock, latest));
+        }
+        auto version = retainedVersions.find(timestamp);
+        if (version == retainedVersions.end()) {
+            throw InvalidInputException("Version " + to_string(timestamp) + " is no longer available");
+        }
+        pinnedVersions.insert(timestamp);
+        return version->second;
+    }
+    
+    void unpinSnapshot(uint64_t timestamp) {
+        auto pin = pinnedVersions.find(timestamp);
+        if (pin != pinnedVersions.end()) pinnedVersions.erase(pin);
+        collectOldVersions();
+    }
+    
+    // Start an online backup of the current version into targetDir, writing
+    // at most bytesPerSecond (0 = unlimited). Returns immediately.
+    void startBackup(const string& targetDir, uint64_t bytesPerSecond) {
+        if (backupJob && !backupJob->finished()) {
+            throw InvalidInputException("A backup is already running");
+        }
+        finishBackup();
+        
+        ostringstream usersData;
+        usersData << "SCHEMA:" << USERS_SCHEMA << "\n";
+        for (const auto& user : users) {
+            usersData << user->serialize() << "\n";
+        }
+        ostringstream sheltersData;
+        for (const auto& shelter : shelters) {
+            sheltersData << shelter.serialize() << "\n";
+        }
+        ostringstream sketchesData;
+        sketchesData << "NEXT_ID:" << nextAppID << "\n";
+        sketches.save(sketchesData);
+        
+        DataSnapshot snapshot = pinSnapshot();
+        backupJob.reset(new BackupJob(targetDir, bytesPerSecond, snapshot, nextPetID, nextAppID,
+                                      usersData.str(), sheltersData.str(), sketchesData.str()));
+    }
+    
+    // Status of the last backup; a finished backup releases its snapshot
+    string getBackupStatus() {
+        if (!backupJob) {
+            return lastBackupStatus.empty() ? "No backup has been started." : lastBackupStatus;
+        }
+        string status = backupJob->status();
+        if (backupJob->finished()) finishBackup();
+        return status;
+    }
+    
+    // Block until the running backup finishes; returns true if it was verified
+    bool waitForBackup() {
+        if (!backupJob) return false;
+        backupJob->wait();
+        bool ok = backupJob->succeeded();
+        cout << backupJob->status() << "\n";
+        finishBackup();
+        return ok;
+    }
+    
+    void finishBackup() {
+        if (!backupJob || !backupJob->finished()) return;
+        backupJob->wait();
+        unpinSnapshot(backupJob->getSnapshotTimestamp());
+        lastBackupStatus = backupJob->status();
+        backupJob.reset();
+    }
+    
+    // Write the pets and applications changed after version `since`, oldest
+    // change first, in the delta format:
+    //   DELTA <since> <current version>
+    //   P+<tab><pet record>        P-<tab><id>,<version>
+    //   A+<tab><application record> A-<tab><id>,<version>
+    //   END <record count>
+    // Only changed records are visited. Returns the number of records written.
+    // Deletions at or before the delta horizon have been pruned, so a delta
+    // must start after it; version 0 asks for every record and needs none.
+    size_t exportChanges(uint64_t since, ostream& out) {
+        if (since > commitClock) {
+            throw InvalidInputException("Version " + to_string(since) + " is newer than the current version " +
+                                        to_string(commitClock));
+        }
+        if (since != 0 && since < deltaHorizon) {
+            throw InvalidInputException("Deletions up to version " + to_string(deltaHorizon) +
+                                        " are no longer tracked; export from version 0 or " +
+                                        to_string(deltaHorizon) + " onwards");
+        }
+        size_t count = 0;
+        out << "DELTA " << since << " " << commitClock << "\n";
+        const auto& positions = getPetPositions();
+        petChanges.forEachSince(since, [&](const string& id, uint64_t version, bool deleted) {
+            if (deleted) out << "P-\t" << id << "," << version << "\n";
+            else out << "P+\t" << pets[positions.at(stoi(id))].serialize() << "\n";
+            count++;
+        });
+        applicationChanges.forEachSince(since, [&](const string& id, uint64_t version, bool deleted) {
+            if (deleted) out << "A-\t" << id << "," << version << "\n";
+            else out << "A+\t" << applications[findApplication(stoi(id))].serialize() << "\n";
+            count++;
+        });
+        out << "END " << count << "\n";
+        if (!out) {
+            throw FileOperationException("Failed to write delta export");
+        }
+        return count;
+    }
+    
+    // Pet operations
+    void addPet(const string& name, const string& breed, Date birthDate, bool vaccinated,
+                int shelterID = 0, const string& description = "") {
+        Pet pet(name, breed, birthDate, vaccinated, shelterID);
+        pet.setDescription(description);
+        recordUndo("Add pet " + name);
+        size_t index = appendPet(pet);
+        stampPet(index);
+        rememberPetName(name);
+        addToPetOrder(pets[index]);
+        indexDescription(index);
+        onPetsChanged();
+        markDirty(PETS_TABLE); // Saved by the next flush
+    }
+    
+    // Only the fields that differ are written and re-indexed. Returns the
+    // changed fields; nothing is recorded if there are none.
+    uint32_t editPet(size_t index, const string& name, const string& breed, Date birthDate, bool vaccinated,
+                     const string& description) {
+        if (index >= pets.size()) {
+            throw out_of_range("Invalid pet index");
+        }
+        Pet edited = pets[index];
+        edited.setName(name);
+        edited.setBreed(breed);
+        edited.setBirthDate(birthDate);
+        edited.setVaccinated(vaccinated);
+        edited.setDescription(description);
+        uint32_t changed = RecordEquality<Pet>::diff(pets[index], edited);
+        if (!changed) return 0;
+        
+        string oldName = pets[index].getName();
+        recordUndo("Edit pet " + oldName);
+        if (changed & fieldBit<Pet::nameField>()) {
+            rememberPetName(name);
+        }
+        if (changed & (fieldBit<Pet::nameField>() | fieldBit<Pet::birthDateField>())) {
+            removeFromPetOrder(pets[index]);
+            addToPetOrder(edited);
+        }
+        pets.mutableAt(index) = edited;
+        stampPet(index);
+        
+        // Edits never touch shelters or adoption, so the locator stays valid
+        if (changed & (fieldBit<Pet::breedField>() | fieldBit<Pet::birthDateField>() |
+                       fieldBit<Pet::vaccinatedField>())) {
+            similarPetsStale = true;
+        }
+        if (changed & fieldBit<Pet::descriptionField>()) descriptionIndexStale = true;
+        
+        // Journal record: version,pet ID,changed fields,their new values
+        string record = to_string(nextVersion()) + "," + to_string(edited.getID()) + "," + to_string(changed) + ",";
+        TextCodec<Pet>::encode(pets[index], record, changed);
+        pendingPetEdits.push_back(record);
+        markDirty(0);
+        return changed;
+    }
+    
+    void deletePet(size_t index) {
+        if (index >= pets.size()) {
+            throw out_of_range("Invalid pet index");
+        }
+        // Photos are released once the deletion drops out of the undo history
+        recordUndo("Delete pet " + pets[index].getName()).deletedPet = pets[index].getID();
+        recordDeletion(petChanges, 'P', to_string(pets[index].getID()));
+        removeFromPetOrder(pets[index]);
+        pets.erase(index);
+        petPositionsStale = true;
+        onPetsChanged();
+        markDirty(PETS_TABLE); // Saved by the next flush
+    }
+    
+    // Sorted listing, one page at a time. With details each pet also shows
+    // its shelter and description.
+    void viewAllPets(bool details = false) {
+        clearScreen();
+        cout << "\n=== ALL PET RECORDS ===\n";
+        if (pets.empty()) {
+            cout << "No pets in the system.\n";
+            return;
+        }
+        PetOrder order = getNumericInput("Sort by (1. Name, 2. Age): ", 1, 2) == 1 ? PETS_BY_NAME : PETS_BY_AGE;
+        int pageCount = static_cast<int>((pets.size() + PETS_PER_PAGE - 1) / PETS_PER_PAGE);
+        int page = 1;
+        
+        while (true) {
+            size_t first = (page - 1) * PETS_PER_PAGE;
+            vector<size_t> positions = getPetPage(order, first, PETS_PER_PAGE);
+            if (!details) {
+                cout << "\nID  | Name          | Breed         | Age | Vaccinated | Status\n";
+                cout << "----+---------------+---------------+-----+------------+--------\n";
+            }
+            for (size_t i = 0; i < positions.size(); ++i) {
+                const Pet& pet = pets[positions[i]];
+                if (details) {
+                    cout << first + i + 1 << ". " << pet.getName()
+                         << " (" << pet.getBreed()
+                         << "), Age: " << pet.getAge()
+                         << ", Vaccinated: " << (pet.isVaccinated() ? "Yes" : "No")
+                         << ", Status: " << (pet.isAdopted() ? "Adopted" : "Available")
+                         << ", Shelter: " << getShelterName(pet.getShelterID()) << "\n";
+                    if (!pet.getDescription().empty()) {
+                        cout << "   " << pet.getDescription() << "\n";
+                    }
+                } else {
+                    cout << left << setw(4) << first + i + 1 << "| "
+                         << setw(15) << pet.getName() << "| "
+                         << setw(15) << pet.getBreed() << "| "
+                         << setw(5) << pet.getAge() << "| "
+                         << setw(12) << (pet.isVaccinated() ? "Yes" : "No") << "| "
+                         << (pet.isAdopted() ? "Adopted" : "Available") << "\n";
+                }
+            }
+            cout << "\nPage " << page << " of " << pageCount << "\n";
+            cout << "1. Next Page\n2. Previous Page\n3. Go to Page\n4. Find Pet\n0. Back\n";
+            int choice = getNumericInput("Enter choice: ", 0, 4);
+            if (choice == 0) return;
+            if (choice == 1) {
+                page = min(page + 1, pageCount);
+            } else if (choice == 2) {
+                page = max(page - 1, 1);
+            } else if (choice == 3) {
+                page = getNumericInput("Enter page: ", 1, pageCount);
+            } else {
+                string name;
+                cout << "Enter pet name: ";
+                getline(cin >> ws, name);
+                if (!hasPet(name)) {
+                    cout << "No pet named " << name << ".\n";
+                    continue;
+                }
+                page = static_cast<int>(getPetRank(order, findPet(name)) / PETS_PER_PAGE) + 1;
+            }
+            clearScreen();
+        }
+    }
+    
+    // Positions into getAllPets() of up to count pets, starting at rank first
+    // of the order
+    vector<size_t> getPetPage(PetOrder order, size_t first, size_t count) {
+        if (petOrderStale) rebuildPetOrder();
+        const auto& positions = getPetPositions();
+        vector<size_t> page;
+        if (order == PETS_BY_NAME) {
+            petsByName.forEach(first, count, [&](const PetNameKey& key) {
+                page.push_back(positions.at(key.second));
+            });
+        } else {
+            petsByAge.forEach(first, count, [&](const PetAgeKey& key) {
+                page.push_back(positions.at(key.second.second));
+            });
+        }
+        return page;
+    }
+    
+    // Number of pets ordered before the pet at index
+    size_t getPetRank(PetOrder order, size_t index) {
+        if (index >= pets.size()) {
+            throw out_of_range("Invalid pet index");
+        }
+        if (petOrderStale) rebuildPetOrder();
+        const Pet& pet = pets[index];
+        return order == PETS_BY_NAME ? petsByName.rank(nameKey(pet))
+                                     : petsByAge.rank(ageKey(pet));
+    }
+    
+    // Ranks [first, last) in the age order of the pets aged minAge to maxAge
+    // today: those born after the date maxAge + 1 years ago, up to the date
+    // minAge years ago
+    pair<size_t, size_t> getAgeRankRange(int minAge, int maxAge) {
+        Date today = Date::today();
+        return make_pair(countBornAfter(today.monthsBefore(minAge * 12).days),
+                         countBornAfter(today.monthsBefore((maxAge + 1) * 12).days));
+    }
+    
+    // Rank in the age order of the first pet born on or before day
+    size_t countBornAfter(int64_t day) {
+        if (petOrderStale) rebuildPetOrder();
+        if (day >= numeric_limits<int32_t>::max()) return 0;
+        if (day < -numeric_limits<int32_t>::max()) return petsByAge.size();
+        return petsByAge.rank(make_pair(-static_cast<int32_t>(day), PetNameKey()));
+    }
+    
+    // Positions of the pets matching query, in table order. A name or age
+    // condition that every match must meet picks the candidates, every pet
+    // with that name or in that birth range, through the name or age order;
+    // otherwise every pet is a candidate. The candidates are then checked in
+    // batches.
+    vector<size_t> queryPets(const PetQuery& query) {
+        vector<size_t> candidates;
+        bool scan = false;
+        int64_t bornFrom, bornTo;
+        if (const string* name = query.getExactName()) {
+            if (petOrderStale) rebuildPetOrder();
+            size_t first = petsByName.rank(make_pair(*name, numeric_limits<int>::min()));
+            size_t last = petsByName.upperRank(make_pair(*name, numeric_limits<int>::max()));
+            if (first < last) candidates = getPetPage(PETS_BY_NAME, first, last - first);
+            sort(candidates.begin(), candidates.end());
+        } else if (query.getBornRange(bornFrom, bornTo)) {
+            size_t first = countBornAfter(bornTo);
+            size_t last = bornFrom == numeric_limits<int64_t>::min() ? pets.size() : countBornAfter(bornFrom - 1);
+            if (first < last) candidates = getPetPage(PETS_BY_AGE, first, last - first);
+            sort(candidates.begin(), candidates.end());
+        } else {
+            scan = true;
+        }
+        
+        vector<size_t> matches;
+        const Pet* batch[PetQuery::BATCH_SIZE] = {};
+        size_t positions[PetQuery::BATCH_SIZE];
+        uint8_t hits[PetQuery::BATCH_SIZE];
+        size_t count = 0;
+        auto runBatch = [&]() {
+            query.evaluate(batch, count, hits);
+            for (size_t i = 0; i < count; ++i) {
+                if (hits[i]) matches.push_back(positions[i]);
+            }
+            count = 0;
+        };
+        auto add = [&](const Pet& pet, size_t position) {
+            batch[count] = &pet;
+            positions[count++] = position;
+            if (count == PetQuery::BATCH_SIZE) runBatch();
+        };
+        if (scan) {
+            size_t position = 0;
+            for (const auto& pet : pets) add(pet, position++);
+        } else {
+            for (size_t position : candidates) add(pets[position], position);
+        }
+        runBatch();
+        return matches;
+    }
+    
+    const PetTable& getAllPets() const { return pets; }
+    
+    // Free-text search over descriptions: (BM25 score, pet index), best first
+    vector<pair<float, size_t>> searchDescriptions(const string& query, size_t k, bool availableOnly) {
+        if (descriptionIndexStale || descriptionIndex.outgrown(pets.size())) {
+            descriptionIndex.build(pets);
+            descriptionIndexStale = false;
+        }
+        // Deleted pets are still in the index; they have no position
+        const auto& positions = getPetPositions();
+        const PetTable& allPets = pets;
+        vector<pair<float, size_t>> results = descriptionIndex.search(query, k, [&](size_t doc) {
+            auto found = positions.find(static_cast<int>(doc));
+            return found != positions.end() && (!availableOnly || !allPets[found->second].isAdopted());
+        });
+        for (auto& result : results) result.second = positions.at(static_cast<int>(result.second));
+        return results;
+    }
+    
+    // Photo operations
+    string addPetPhoto(size_t index, const string& imagePath) {
+        if (index >= pets.size()) {
+            throw out_of_range("Invalid pet index");
+        }
+        ifstream in(imagePath, ios::binary);
+        if (!in.is_open()) {
+            throw FileOperationException("Failed to open " + imagePath);
+        }
+        string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        return photoStore.addPhoto(pets[index].getID(), bytes);
+    }
+    
+    vector<string> getPetPhotos(size_t index) const {
+        if (index >= pets.size()) {
+            throw out_of_range("Invalid pet index");
+        }
+        return photoStore.getPhotos(pets[index].getID());
+    }
+    
+    const PhotoStore& getPhotoStore() const { return photoStore; }
+    
+    // Shelter operations
+    void addShelter(const string& name, double latitude, double longitude) {
+        shelters.emplace_back(nextShelterID++, name, latitude, longitude);
+        petLocatorStale = true;
+        markDirty(SHELTERS_TABLE);
+    }
+    
+    void assignPetToShelter(size_t index, int shelterID) {
+        if (index >= pets.size()) {
+            throw out_of_range("Invalid pet index");
+        }
+        recordUndo("Move pet " + pets[index].getName());
+        pets.mutableAt(index).setShelterID(shelterID);
+        stampPet(index);
+        onPetsChanged();
+        markDirty(PETS_TABLE);
+    }
+    
+    const vector<Shelter>& getAllShelters() const { return shelters; }
+    const ApplicationSketches& getApplicationSketches() const { return sketches; }
+    
+    string getShelterName(int shelterID) const {
+        for (const auto& shelter : shelters) {
+            if (shelter.getID() == shelterID) return shelter.getName();
+        }
+        return "Unassigned";
+    }
+    
+    // Location queries over available pets: (distance in km, pet index)
+    vector<pair<double, size_t>> findPetsWithin(double latitude, double longitude,
+                                                double radiusKm, const PetFilter& filter) {
+        return getPetLocator().within(latitude, longitude, radiusKm, filter);
+    }
+    
+    vector<pair<double, size_t>> findNearestPets(double latitude, double longitude,
+                                                 size_t k, const PetFilter& filter) {
+        return getPetLocator().nearest(latitude, longitude, k, filter);
+    }
+    
+    // Application operations
+    void createApplication(const string& username, const string& petName) {
+        if (!activeApplications.insert(make_pair(username, petName)).second) {
+            throw InvalidInputException("You already have an active application for " + petName);
+        }
+        size_t pet = findPet(petName);
+        int petID = pet == pets.size() ? 0 : pets[pet].getID();
+        applications.push_back(Application(nextAppID++, username, petName, petID));
+        stampApplication(applications.size() - 1);
+        if (petID != 0) recommender.recordApplication(username, petID);
+        recordInSketches(applications[applications.size() - 1]);
+        markDirty(APPLICATIONS_TABLE); // Save when a new application is created
+    }
+    
+    void processApplication(size_t index, bool approve) {
+        if (index >= applications.size()) {
+            throw out_of_range("Invalid application index");
+        }
+        
+        recordUndo((approve ? "Approve application #" : "Reject application #") +
+                   to_string(applications[index].getID()));
+        unsigned changed = APPLICATIONS_TABLE;
+        if (approve) {
+            applications.mutableAt(index).approve();
+            auto pet = getPetPositions().find(applications[index].getPetID());
+            if (pet != getPetPositions().end()) {
+                pets.mutableAt(pet->second).markAsAdopted();
+                stampPet(pet->second);
+                onPetsChanged();
+                changed |= PETS_TABLE; // Save pet status change
+            }
+        } else {
+            applications.mutableAt(index).reject();
+            // A rejected applicant may apply for the same pet again
+            activeApplications.erase(make_pair(applications[index].getUsername(),
+                                               applications[index].getPetName()));
+        }
+        
+        stampApplication(index);
+        // Save applications to file
+        markDirty(changed);
+    }
+    
+    const ApplicationTable& getAllApplications() const { return applications; }
+    
+    // Indices of up to k available pets most similar to the given pet
+    vector<size_t> findSimilarPets(size_t index, size_t k) {
+        if (index >= pets.size()) {
+            throw out_of_range("Invalid pet index");
+        }
+        if (similarPetsStale) {
+            similarPets.build(pets);
+            similarPetsStale = false;
+        }
+        return similarPets.findSimilar(pets[index], k, index);
+    }
+    
+    // Indices of up to k available pets recommended for the user
+    vector<size_t> recommendPets(const string& username, size_t k) {
+        const unordered_map<int, size_t>& positions = getPetPositions();
+        auto available = [&](int petID) {
+            auto pet = positions.find(petID);
+            return pet != positions.end() && !pets[pet->second].isAdopted();
+        };
+        vector<size_t> result;
+        for (int petID : recommender.recommend(username, k, available)) {
+            result.push_back(positions.at(petID));
+        }
+        return result;
+    }
+    
+    // Search operations
+    vector<Pet> searchPets(unique_ptr<SearchStrategy> strategy) const {
+        return strategy->search(pets);
+    }
+    
+    // User management
+    void addUser(unique_ptr<User> user) {
+        users.push_back(move(user));
+        rememberUsername(users.back()->getUsername());
+        markDirty(USERS_TABLE);
+    }
+    
+    // Exact answers; the filters skip the lookup for most unknown keys
+    bool hasUser(const string& username) const {
+        if (!userFilter.mayContain(stableHash(username))) return false;
+        for (const auto& user : users) {
+            if (user->getUsername() == username) return true;
+        }
+        return false;
+    }
+    
+    bool hasPet(const string& name) {
+        return petFilter.mayContain(stableHash(name)) && findPet(name) != pets.size();
+    }
+    
+    // Bulk imports: beginImport() records one undo entry, the import calls
+    // append records without saving, and finishImport() commits them together
+    void beginImport(const string& action) {
+        recordUndo(action);
+    }
+    
+    void importPet(const Pet& pet) {
+        size_t index = appendPet(pet);
+        stampPet(index);
+        rememberPetName(pet.getName());
+        addToPetOrder(pets[index]);
+        indexDescription(index);
+    }
+    
+    // Returns false if the user already has an active application for the pet.
+    // An approved application marks the pet adopted.
+    bool importApplication(const string& username, const string& petName, const string& status,
+                           time_t submittedAt, time_t decidedAt) {
+        if (status != "Rejected" && !activeApplications.insert(make_pair(username, petName)).second) {
+            return false;
+        }
+        size_t pet = findPet(petName);
+        Application app(nextAppID++, username, petName, pet == pets.size() ? 0 : pets[pet].getID());
+        app.setSubmittedAt(submittedAt);
+        if (status == "Approved") {
+            app.approve(decidedAt);
+            if (pet != pets.size() && !pets[pet].isAdopted()) {
+                pets.mutableAt(pet).markAsAdopted();
+                stampPet(pet);
+            }
+        } else if (status == "Rejected") {
+            app.reject(decidedAt);
+        }
+        applications.push_back(app);
+        stampApplication(applications.size() - 1);
+        if (app.getPetID() != 0) recommender.recordApplication(username, app.getPetID(), false);
+        recordInSketches(app);
+        return true;
+    }
+    
+    void importUser(unique_ptr<User> user) {
         users.push_back(move(user));
-        saveUsersToFile();
+        rememberUsername(users.back()->getUsername());
+    }
+    
+    void finishImport(unsigned tables) {
+        if (tables & PETS_TABLE) onPetsChanged();
+        if (tables & APPLICATIONS_TABLE) recommender.rebuildNeighbors();
+        markDirty(tables);
+    }
+    
+    void deleteUser(size_t index) {
+        if (index >= users.size()) {
+            throw out_of_range("Invalid user index");
+        }
+        users.erase(users.begin() + index);
+        markDirty(USERS_TABLE);
+    }
+    
+    // Only the fields that differ are updated; returns false if none did
+    bool updateUser(size_t index, const string& username, const string& password) {
+        if (index >= users.size()) {
+            throw out_of_range("Invalid user index");
+        }
+        User& user = *users[index];
+        bool changed = false;
+        if (user.getUsername() != username) {
+            user.setUsername(username);
+            rememberUsername(username);
+            changed = true;
+        }
+        if (user.getPassword() != password) {
+            user.setPassword(password);
+            changed = true;
+        }
+        if (!changed) return false;
+        markDirty(USERS_TABLE);
+        return true;
+    }
+    
+    const vector<unique_ptr<User>>& getAllUsers() const { return users; }
+    
+    // Friend classes for protected access
+    friend class Admin;
+    friend class RegularUser;
+    friend class ShelterRegistry;
+};
+
+// Registry Pattern: one PetAdoptionSystem per shelter data directory
+class ShelterRegistry {
+private:
+    map<string, unique_ptr<PetAdoptionSystem>> tenants;
+    
+    ShelterRegistry() {}
+public:
+    ShelterRegistry(const ShelterRegistry&) = delete;
+    ShelterRegistry& operator=(const ShelterRegistry&) = delete;
+    
+    static ShelterRegistry& getInstance() {
+        static ShelterRegistry registry;
+        return registry;
+    }
+    
+    // Open (or return the already open) shelter stored in dataDir
+    PetAdoptionSystem& open(const string& name, const string& dataDir) {
+        auto it = tenants.find(name);
+        if (it == tenants.end()) {
+            it = tenants.insert(make_pair(name,
+                unique_ptr<PetAdoptionSystem>(new PetAdoptionSystem(dataDir)))).first;
+        } else if (it->second->getDataDirectory() != dataDir) {
+            throw InvalidInputException("Shelter " + name + " is already open from another directory");
+        }
+        return *it->second;
+    }
+    
+    PetAdoptionSystem& get(const string& name) {
+        auto it = tenants.find(name);
+        if (it == tenants.end()) {
+            throw InvalidInputException("Unknown shelter: " + name);
+        }
+        return *it->second;
+    }
+    
+    // Flush and drop a shelter's data set
+    void close(const string& name) {
+        tenants.erase(name);
+    }
+    
+    vector<string> getShelterNames() const {
+        vector<string> names;
+        for (const auto& tenant : tenants) names.push_back(tenant.first);
+        return names;
+    }
+    
+    void flushAll() {
+        for (auto& tenant : tenants) tenant.second->flush();
+    }
+};
+
+// A pinned, consistent view of a shelter's tables for long-running readers.
+// The version stays readable until the snapshot goes out of scope.
+class ReportSnapshot {
+private:
+    PetAdoptionSystem& system;
+    DataSnapshot data;
+public:
+    explicit ReportSnapshot(PetAdoptionSystem& sys) : system(sys), data(sys.pinSnapshot()) {}
+    ReportSnapshot(PetAdoptionSystem& sys, uint64_t timestamp)
+        : system(sys), data(sys.pinSnapshot(timestamp)) {}
+    ~ReportSnapshot() { system.unpinSnapshot(data.timestamp); }
+    
+    ReportSnapshot(const ReportSnapshot&) = delete;
+    ReportSnapshot& operator=(const ReportSnapshot&) = delete;
+    
+    uint64_t timestamp() const { return data.timestamp; }
+    const PetTable& pets() const { return data.pets; }
+    const ApplicationTable& applications() const { return data.applications; }
+};
+
+// Inner equi-join of two tables on a hashable key. A hash table is built over
+// the build side and probed with every row of the probe side; emit(buildRow,
+// probeRow) is called once per matching pair. Build sides above
+// RADIX_THRESHOLD rows are radix-partitioned on the key hash first, together
+// with the probe side, so each partition's hash table stays in cache. Matches
+// come out partition by partition, in probe order within a partition.
+class HashJoin {
+public:
+    template <typename BuildTable, typename BuildKey, typename ProbeTable, typename ProbeKey, typename Emit>
+    static size_t run(const BuildTable& build, BuildKey buildKey,
+                      const ProbeTable& probe, ProbeKey probeKey, Emit emit) {
+        typedef typename decay<decltype(*build.begin())>::type BuildRow;
+        typedef typename decay<decltype(*probe.begin())>::type ProbeRow;
+        
+        unsigned bits = 0;
+        while (bits < MAX_RADIX_BITS && build.size() >= RADIX_THRESHOLD &&
+               (build.size() >> bits) > PARTITION_ROWS) {
+            bits++;
+        }
+        vector<Row<BuildRow>> buildRows = partition(build, buildKey, bits);
+        vector<Row<ProbeRow>> probeRows = partition(probe, probeKey, bits);
+        
+        size_t matches = 0;
+        vector<uint32_t> slots;
+        size_t buildBegin = 0, probeBegin = 0;
+        while (buildBegin < buildRows.size() && probeBegin < probeRows.size()) {
+            // Rows are grouped by partition; find the next partition on each side
+            size_t part = min(buildRows[buildBegin].hash & lowMask(bits),
+                              probeRows[probeBegin].hash & lowMask(bits));
+            size_t buildEnd = buildBegin, probeEnd = probeBegin;
+            while (buildEnd < buildRows.size() && (buildRows[buildEnd].hash & lowMask(bits)) == part) buildEnd++;
+            while (probeEnd < probeRows.size() && (probeRows[probeEnd].hash & lowMask(bits)) == part) probeEnd++;
+            
+            if (buildEnd > buildBegin && probeEnd > probeBegin) {
+                size_t capacity = 16;
+                while (capacity < 2 * (buildEnd - buildBegin)) capacity <<= 1;
+                size_t mask = capacity - 1;
+                slots.assign(capacity, static_cast<uint32_t>(EMPTY));
+                for (size_t i = buildBegin; i < buildEnd; ++i) {
+                    size_t slot = (buildRows[i].hash >> bits) & mask;
+                    while (slots[slot] != EMPTY) slot = (slot + 1) & mask;
+                    slots[slot] = static_cast<uint32_t>(i - buildBegin);
+                }
+                for (size_t i = probeBegin; i < probeEnd; ++i) {
+                    const Row<ProbeRow>& row = probeRows[i];
+                    for (size_t slot = (row.hash >> bits) & mask; slots[slot] != EMPTY; slot = (slot + 1) & mask) {
+                        const Row<BuildRow>& candidate = buildRows[buildBegin + slots[slot]];
+                        if (candidate.hash == row.hash && buildKey(*candidate.row) == probeKey(*row.row)) {
+                            emit(*candidate.row, *row.row);
+                            matches++;
+                        }
+                    }
+                }
+            }
+            buildBegin = buildEnd;
+            probeBegin = probeEnd;
+        }
+        return matches;
+    }
+    
+private:
+    static const size_t RADIX_THRESHOLD = 1 << 15;  // build rows before partitioning pays off
+    static const size_t PARTITION_ROWS = 1 << 12;   // target build rows per partition
+    static const unsigned MAX_RADIX_BITS = 12;
+    static const uint32_t EMPTY = 0xffffffffu;
+    
+    template <typename T>
+    struct Row {
+        size_t hash;
+        const T* row;
+    };
+    
+    static size_t lowMask(unsigned bits) { return (size_t(1) << bits) - 1; }
+    
+    // Hash every row's key and group the rows by the low `bits` of the hash
+    // with a counting sort, keeping table order within each partition
+    template <typename Table, typename Key>
+    static vector<Row<typename decay<decltype(*declval<const Table&>().begin())>::type>>
+    partition(const Table& table, Key key, unsigned bits) {
+        typedef typename decay<decltype(*table.begin())>::type T;
+        hash<typename decay<decltype(key(*table.begin()))>::type> hasher;
+        vector<Row<T>> rows;
+        rows.reserve(table.size());
+        for (const auto& row : table) {
+            Row<T> entry = { hasher(key(row)), &row };
+            rows.push_back(entry);
+        }
+        if (bits == 0) return rows;
+        
+        vector<size_t> offsets((size_t(1) << bits) + 1, 0);
+        for (const auto& row : rows) offsets[(row.hash & lowMask(bits)) + 1]++;
+        for (size_t i = 1; i < offsets.size(); ++i) offsets[i] += offsets[i - 1];
+        vector<Row<T>> partitioned(rows.size());
+        for (const auto& row : rows) partitioned[offsets[row.hash & lowMask(bits)]++] = row;
+        return partitioned;
+    }
+};
+
+// Spill files for the external sort and aggregation: length-prefixed records
+class SpillWriter {
+private:
+    ofstream out;
+public:
+    explicit SpillWriter(const string& path) : out(path, ios::binary) {
+        if (!out.is_open()) {
+            throw FileOperationException("Failed to create spill file " + path);
+        }
+    }
+    
+    void write(const string& record) {
+        uint32_t length = static_cast<uint32_t>(record.size());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(record.data(), record.size());
+    }
+    
+    void close() {
+        out.close();
+        if (!out) {
+            throw FileOperationException("Failed to write spill file");
+        }
+    }
+};
+
+class SpillReader {
+private:
+    ifstream in;
+public:
+    explicit SpillReader(const string& path) : in(path, ios::binary) {
+        if (!in.is_open()) {
+            throw FileOperationException("Failed to open spill file " + path);
+        }
+    }
+    
+    bool read(string& record) {
+        uint32_t length;
+        if (!in.read(reinterpret_cast<char*>(&length), sizeof(length))) return false;
+        record.resize(length);
+        return length == 0 || static_cast<bool>(in.read(&record[0], length));
+    }
+};
+
+// Unique names for spill files in a temp directory
+inline string spillPath(const string& tempDir, const string& kind) {
+    static atomic<unsigned> counter(0);
+    #ifdef _WIN32
+    unsigned long process = GetCurrentProcessId();
+    #else
+    unsigned long process = static_cast<unsigned long>(getpid());
+    #endif
+    return tempDir + "/" + kind + "-" + to_string(process) + "-" + to_string(counter++) + ".tmp";
+}
+
+// External merge sort of records under a memory budget. Records are ordered
+// byte-wise, so callers put the sort key first. Records are buffered until
+// the budget is used, then sorted and spilled as a run file; finish() merges
+// the runs (at most MAX_FAN_IN at a time) and visits every record in order.
+class ExternalSorter {
+private:
+    static const size_t MAX_FAN_IN = 64;
+    static const size_t RECORD_OVERHEAD = sizeof(string);
+    
+    string tempDir;
+    size_t memoryLimit;
+    vector<string> buffer;
+    size_t bufferBytes = 0;
+    vector<string> runs;
+    
+    void spill() {
+        sort(buffer.begin(), buffer.end());
+        runs.push_back(spillPath(tempDir, "sort"));
+        SpillWriter writer(runs.back());
+        for (const auto& record : buffer) writer.write(record);
+        writer.close();
+        vector<string>().swap(buffer);
+        bufferBytes = 0;
+    }
+    
+    // k-way merge of runs [first, last) into visit(record)
+    template <typename Visitor>
+    void merge(size_t first, size_t last, Visitor visit) {
+        vector<unique_ptr<SpillReader>> readers;
+        vector<string> heads(last - first);
+        typedef pair<const string*, size_t> HeapEntry;
+        auto greater = [](const HeapEntry& a, const HeapEntry& b) { return *a.first > *b.first; };
+        priority_queue<HeapEntry, vector<HeapEntry>, decltype(greater)> heap(greater);
+        for (size_t i = first; i < last; ++i) {
+            readers.push_back(unique_ptr<SpillReader>(new SpillReader(runs[i])));
+            if (readers.back()->read(heads[i - first])) heap.push(make_pair(&heads[i - first], i - first));
+        }
+        while (!heap.empty()) {
+            size_t source = heap.top().second;
+            heap.pop();
+            visit(heads[source]);
+            if (readers[source]->read(heads[source])) heap.push(make_pair(&heads[source], source));
+        }
+    }
+    
+    void removeRuns() {
+        for (const auto& run : runs) remove(run.c_str());
+        runs.clear();
+    }
+    
+public:
+    ExternalSorter(const string& tempDirectory, size_t memoryLimitBytes)
+        : tempDir(tempDirectory), memoryLimit(memoryLimitBytes) {
+        makeDirectory(tempDir);
+    }
+    
+    ~ExternalSorter() { removeRuns(); }
+    
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+    
+    void add(const string& record) {
+        buffer.push_back(record);
+        bufferBytes += record.size() + RECORD_OVERHEAD;
+        if (bufferBytes >= memoryLimit) spill();
+    }
+    
+    size_t runCount() const { return runs.size(); }
+    
+    // Visit every record in sorted order; the sorter is empty afterwards
+    template <typename Visitor>
+    void finish(Visitor visit) {
+        if (runs.empty()) {
+            sort(buffer.begin(), buffer.end());
+            for (const auto& record : buffer) visit(record);
+            vector<string>().swap(buffer);
+            bufferBytes = 0;
+            return;
+        }
+        if (!buffer.empty()) spill();
+        // Reduce the run count below the fan-in with intermediate merge passes
+        size_t next = 0;
+        while (runs.size() - next > MAX_FAN_IN) {
+            string merged = spillPath(tempDir, "sort");
+            SpillWriter writer(merged);
+            merge(next, next + MAX_FAN_IN, [&](const string& record) { writer.write(record); });
+            writer.close();
+            for (size_t i = next; i < next + MAX_FAN_IN; ++i) remove(runs[i].c_str());
+            next += MAX_FAN_IN;
+            runs.push_back(merged);
+        }
+        runs.erase(runs.begin(), runs.begin() + next);
+        merge(0, runs.size(), visit);
+        removeRuns();
+    }
+};
+
+// Hash aggregation of counters per key under a memory budget. When the table
+// outgrows the budget it is spilled into hash partitions on disk; finish()
+// aggregates each partition on its own, repartitioning any that still do not
+// fit. Results are visited in no particular order.
+class ExternalAggregator {
+public:
+    typedef vector<uint64_t> Counters;
+    
+private:
+    static const size_t PARTITIONS = 16;
+    static const unsigned MAX_DEPTH = 4;
+    static const size_t ENTRY_OVERHEAD = 64;   // hash node, key and counter vector headers
+    
+    string tempDir;
+    size_t memoryLimit;
+    size_t width;
+    
+    static size_t partitionOf(const string& key, unsigned depth) {
+        return (hash<string>()(key) >> (depth * 4)) % PARTITIONS;
+    }
+    
+    string encode(const string& key, const Counters& counters) const {
+        string record(reinterpret_cast<const char*>(counters.data()), width * sizeof(uint64_t));
+        return record + key;
+    }
+    
+    void decode(const string& record, string& key, Counters& counters) const {
+        counters.resize(width);
+        memcpy(counters.data(), record.data(), width * sizeof(uint64_t));
+        key.assign(record, width * sizeof(uint64_t), string::npos);
+    }
+    
+    // Aggregates records into `table`; spills to partitions at `depth` when full
+    class Level {
+    public:
+        ExternalAggregator& owner;
+        unsigned depth;
+        unordered_map<string, Counters> table;
+        size_t bytes = 0;
+        vector<string> partitions;
+        vector<unique_ptr<SpillWriter>> writers;
+        
+        Level(ExternalAggregator& o, unsigned d) : owner(o), depth(d) {}
+        ~Level() {
+            writers.clear();
+            for (const auto& path : partitions) remove(path.c_str());
+        }
+        
+        void add(const string& key, const Counters& counters) {
+            auto entry = table.find(key);
+            if (entry == table.end()) {
+                table.insert(make_pair(key, counters));
+                bytes += key.size() + owner.width * sizeof(uint64_t) + ENTRY_OVERHEAD;
+                if (bytes >= owner.memoryLimit && depth < MAX_DEPTH) spill();
+                return;
+            }
+            for (size_t i = 0; i < owner.width; ++i) entry->second[i] += counters[i];
+        }
+        
+        void spill() {
+            if (writers.empty()) {
+                for (size_t i = 0; i < PARTITIONS; ++i) {
+                    partitions.push_back(spillPath(owner.tempDir, "aggregate"));
+                    writers.push_back(unique_ptr<SpillWriter>(new SpillWriter(partitions.back())));
+                }
+            }
+            for (const auto& entry : table) {
+                writers[partitionOf(entry.first, depth)]->write(owner.encode(entry.first, entry.second));
+            }
+            unordered_map<string, Counters>().swap(table);
+            bytes = 0;
+        }
+        
+        template <typename Visitor>
+        void finish(Visitor& visit) {
+            if (writers.empty()) {
+                for (const auto& entry : table) visit(entry.first, entry.second);
+                return;
+            }
+            spill();
+            for (auto& writer : writers) writer->close();
+            writers.clear();
+            string record, key;
+            Counters counters;
+            for (const auto& path : partitions) {
+                Level next(owner, depth + 1);
+                SpillReader reader(path);
+                while (reader.read(record)) {
+                    owner.decode(record, key, counters);
+                    next.add(key, counters);
+                }
+                next.finish(visit);
+            }
+        }
+    };
+    
+    Level top;
+    
+public:
+    ExternalAggregator(const string& tempDirectory, size_t memoryLimitBytes, size_t counterCount)
+        : tempDir(tempDirectory), memoryLimit(memoryLimitBytes), width(counterCount), top(*this, 0) {
+        makeDirectory(tempDir);
+    }
+    
+    ExternalAggregator(const ExternalAggregator&) = delete;
+    ExternalAggregator& operator=(const ExternalAggregator&) = delete;
+    
+    // Add counters (counterCount values) to the key's totals
+    void add(const string& key, const Counters& counters) { top.add(key, counters); }
+    
+    bool spilled() const { return !top.partitions.empty(); }
+    
+    // Visit visit(key, totals) once per key
+    template <typename Visitor>
+    void finish(Visitor visit) { top.finish(visit); }
+};
+
+// Columnar file format (.pcol) for analytics tools, one file per table:
+//   magic | column chunks of row group 0 | ... | footer | u32 footer size | magic
+// The footer holds the schema and, per row group, its row count and each
+// column chunk's offset, length and min/max statistics, so readers can load
+// only the columns (and row groups) they need. Chunk encodings:
+//   INT64   n little-endian int64 values
+//   BOOL    n bits, least significant bit first
+//   STRING  u32 dictionary size, entries as u32 length + bytes, u8 code
+//           width (1, 2 or 4 bytes), then n little-endian dictionary codes
+// Integers are written in host order, which must be little-endian.
+enum class ColumnType : uint8_t { INT64 = 1, BOOL = 2, STRING = 3 };
+
+struct ColumnSpec {
+    string name;
+    ColumnType type;
+};
+
+struct ColumnStats {
+    int64_t minInt = 0, maxInt = 0;         // INT64 and BOOL columns
+    string minString, maxString;            // STRING columns
+};
+
+class ColumnarFormat {
+protected:
+    static const char* magic() { return "PCOLUMN1"; }
+    static const size_t MAGIC_SIZE = 8;
+    
+    struct ChunkInfo {
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        ColumnStats stats;
+    };
+    
+    struct RowGroupInfo {
+        uint64_t rows = 0;
+        vector<ChunkInfo> chunks;
+    };
+    
+    template <typename T>
+    static void put(string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    
+    static void putString(string& out, const string& value) {
+        put<uint32_t>(out, static_cast<uint32_t>(value.size()));
+        out += value;
+    }
+    
+    template <typename T>
+    static T get(const string& in, size_t& pos) {
+        if (pos + sizeof(T) > in.size()) throw FileOperationException("Truncated columnar data");
+        T value;
+        memcpy(&value, in.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+    
+    static string getString(const string& in, size_t& pos) {
+        uint32_t length = get<uint32_t>(in, pos);
+        if (pos + length > in.size()) throw FileOperationException("Truncated columnar data");
+        pos += length;
+        return in.substr(pos - length, length);
+    }
+};
+
+class ColumnarWriter : private ColumnarFormat {
+private:
+    string path;
+    vector<ColumnSpec> schema;
+    ofstream out;
+    uint64_t offset = 0;
+    vector<RowGroupInfo> rowGroups;
+    string chunk;
+    
+    struct DerefHash {
+        size_t operator()(const string* value) const { return hash<string>()(*value); }
+    };
+    struct DerefEqual {
+        bool operator()(const string* a, const string* b) const { return *a == *b; }
+    };
+    
+    void writeChunk(ChunkInfo& info) {
+        out.write(chunk.data(), chunk.size());
+        info.offset = offset;
+        info.length = chunk.size();
+        offset += chunk.size();
+    }
+    
+    void encodeStrings(const vector<const string*>& values, ColumnStats& stats) {
+        unordered_map<const string*, uint32_t, DerefHash, DerefEqual> codes;
+        codes.reserve(values.size());
+        vector<const string*> dictionary;
+        vector<uint32_t> rowCodes;
+        rowCodes.reserve(values.size());
+        // Consecutive repeats (sorted or clustered columns) skip the hash lookup
+        const string* previous = nullptr;
+        uint32_t previousCode = 0;
+        for (const string* value : values) {
+            if (!previous || *value != *previous) {
+                auto entry = codes.insert(make_pair(value, static_cast<uint32_t>(dictionary.size())));
+                if (entry.second) dictionary.push_back(value);
+                previous = value;
+                previousCode = entry.first->second;
+            }
+            rowCodes.push_back(previousCode);
+        }
+        
+        put<uint32_t>(chunk, static_cast<uint32_t>(dictionary.size()));
+        for (size_t i = 0; i < dictionary.size(); ++i) {
+            putString(chunk, *dictionary[i]);
+            if (i == 0 || *dictionary[i] < stats.minString) stats.minString = *dictionary[i];
+            if (i == 0 || *dictionary[i] > stats.maxString) stats.maxString = *dictionary[i];
+        }
+        uint8_t width = dictionary.size() <= 0x100 ? 1 : dictionary.size() <= 0x10000 ? 2 : 4;
+        put<uint8_t>(chunk, width);
+        size_t start = chunk.size();
+        chunk.resize(start + rowCodes.size() * width);
+        char* codeBytes = &chunk[start];
+        for (size_t i = 0; i < rowCodes.size(); ++i) {
+            memcpy(codeBytes + i * width, &rowCodes[i], width);
+        }
+    }
+    
+public:
+    ColumnarWriter(const string& filePath, const vector<ColumnSpec>& columns)
+        : path(filePath), schema(columns), out(filePath, ios::binary) {
+        if (!out.is_open()) {
+            throw FileOperationException("Failed to open " + filePath + " for writing");
+        }
+        out.write(magic(), MAGIC_SIZE);
+        offset = MAGIC_SIZE;
+    }
+    
+    // Append one row group of `rows` rows. ints[c] holds the values of INT64
+    // and BOOL columns, strings[c] those of STRING columns.
+    void writeRowGroup(size_t rows, const vector<vector<int64_t>>& ints,
+                       const vector<vector<const string*>>& strings) {
+        RowGroupInfo group;
+        group.rows = rows;
+        group.chunks.resize(schema.size());
+        for (size_t c = 0; c < schema.size(); ++c) {
+            ColumnStats& stats = group.chunks[c].stats;
+            chunk.clear();
+            if (schema[c].type == ColumnType::STRING) {
+                encodeStrings(strings[c], stats);
+            } else {
+                const vector<int64_t>& values = ints[c];
+                if (!values.empty()) {
+                    auto range = minmax_element(values.begin(), values.end());
+                    stats.minInt = *range.first;
+                    stats.maxInt = *range.second;
+                }
+                if (schema[c].type == ColumnType::INT64) {
+                    chunk.assign(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(int64_t));
+                } else {
+                    chunk.assign((values.size() + 7) / 8, '\0');
+                    for (size_t i = 0; i < values.size(); ++i) {
+                        if (values[i]) chunk[i / 8] |= static_cast<char>(1 << (i % 8));
+                    }
+                }
+            }
+            writeChunk(group.chunks[c]);
+        }
+        rowGroups.push_back(group);
+    }
+    
+    void close() {
+        string footer;
+        put<uint32_t>(footer, static_cast<uint32_t>(schema.size()));
+        for (const auto& column : schema) {
+            put<uint8_t>(footer, static_cast<uint8_t>(column.type));
+            putString(footer, column.name);
+        }
+        put<uint32_t>(footer, static_cast<uint32_t>(rowGroups.size()));
+        for (const auto& group : rowGroups) {
+            put<uint64_t>(footer, group.rows);
+            for (size_t c = 0; c < schema.size(); ++c) {
+                const ChunkInfo& info = group.chunks[c];
+                put<uint64_t>(footer, info.offset);
+                put<uint64_t>(footer, info.length);
+                if (schema[c].type == ColumnType::STRING) {
+                    putString(footer, info.stats.minString);
+                    putString(footer, info.stats.maxString);
+                } else {
+                    put<int64_t>(footer, info.stats.minInt);
+                    put<int64_t>(footer, info.stats.maxInt);
+                }
+            }
+        }
+        put<uint32_t>(footer, static_cast<uint32_t>(footer.size()));
+        footer.append(magic(), MAGIC_SIZE);
+        out.write(footer.data(), footer.size());
+        out.close();
+        if (!out) {
+            throw FileOperationException("Failed to write " + path);
+        }
+    }
+};
+
+// Reads the footer up front; column chunks are read on demand
+class ColumnarReader : private ColumnarFormat {
+public:
+    struct ColumnValues {
+        ColumnType type;
+        vector<int64_t> ints;       // INT64 and BOOL columns
+        vector<string> strings;     // STRING columns
+    };
+    
+private:
+    ifstream in;
+    vector<ColumnSpec> columns;
+    vector<RowGroupInfo> rowGroups;
+    
+    ColumnValues decode(ColumnType type, const string& data, size_t rows) const {
+        ColumnValues values;
+        values.type = type;
+        size_t pos = 0;
+        if (type == ColumnType::INT64) {
+            if (data.size() != rows * sizeof(int64_t)) throw FileOperationException("Corrupt INT64 column");
+            values.ints.resize(rows);
+            if (rows > 0) memcpy(values.ints.data(), data.data(), data.size());
+        } else if (type == ColumnType::BOOL) {
+            if (data.size() != (rows + 7) / 8) throw FileOperationException("Corrupt BOOL column");
+            values.ints.resize(rows);
+            for (size_t i = 0; i < rows; ++i) values.ints[i] = (data[i / 8] >> (i % 8)) & 1;
+        } else {
+            vector<string> dictionary(get<uint32_t>(data, pos));
+            for (auto& entry : dictionary) entry = getString(data, pos);
+            uint8_t width = get<uint8_t>(data, pos);
+            if ((width != 1 && width != 2 && width != 4) || data.size() - pos != rows * width) {
+                throw FileOperationException("Corrupt STRING column");
+            }
+            values.strings.reserve(rows);
+            for (size_t i = 0; i < rows; ++i) {
+                uint32_t code = 0;
+                memcpy(&code, data.data() + pos + i * width, width);
+                if (code >= dictionary.size()) throw FileOperationException("Corrupt STRING column");
+                values.strings.push_back(dictionary[code]);
+            }
+        }
+        return values;
+    }
+    
+public:
+    explicit ColumnarReader(const string& path) : in(path, ios::binary) {
+        if (!in.is_open()) {
+            throw FileOperationException("Failed to open " + path);
+        }
+        in.seekg(0, ios::end);
+        uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+        string tail(sizeof(uint32_t) + MAGIC_SIZE, '\0');
+        if (fileSize < 2 * MAGIC_SIZE + sizeof(uint32_t)) throw FileOperationException(path + " is not a columnar file");
+        in.seekg(fileSize - tail.size());
+        in.read(&tail[0], tail.size());
+        if (tail.compare(sizeof(uint32_t), MAGIC_SIZE, magic()) != 0) {
+            throw FileOperationException(path + " is not a columnar file");
+        }
+        size_t pos = 0;
+        uint32_t footerSize = get<uint32_t>(tail, pos);
+        if (footerSize > fileSize - tail.size() - MAGIC_SIZE) throw FileOperationException("Corrupt columnar footer");
+        
+        string footer(footerSize, '\0');
+        in.seekg(fileSize - tail.size() - footerSize);
+        in.read(&footer[0], footerSize);
+        pos = 0;
+        columns.resize(get<uint32_t>(footer, pos));
+        for (auto& column : columns) {
+            column.type = static_cast<ColumnType>(get<uint8_t>(footer, pos));
+            column.name = getString(footer, pos);
+        }
+        rowGroups.resize(get<uint32_t>(footer, pos));
+        for (auto& group : rowGroups) {
+            group.rows = get<uint64_t>(footer, pos);
+            group.chunks.resize(columns.size());
+            for (size_t c = 0; c < columns.size(); ++c) {
+                ChunkInfo& info = group.chunks[c];
+                info.offset = get<uint64_t>(footer, pos);
+                info.length = get<uint64_t>(footer, pos);
+                if (info.offset + info.length > fileSize) throw FileOperationException("Corrupt columnar footer");
+                if (columns[c].type == ColumnType::STRING) {
+                    info.stats.minString = getString(footer, pos);
+                    info.stats.maxString = getString(footer, pos);
+                } else {
+                    info.stats.minInt = get<int64_t>(footer, pos);
+                    info.stats.maxInt = get<int64_t>(footer, pos);
+                }
+            }
+        }
+    }
+    
+    const vector<ColumnSpec>& schema() const { return columns; }
+    size_t rowGroupCount() const { return rowGroups.size(); }
+    size_t rowCount(size_t group) const { return rowGroups.at(group).rows; }
+    const ColumnStats& stats(size_t group, size_t column) const { return rowGroups.at(group).chunks.at(column).stats; }
+    
+    size_t columnIndex(const string& name) const {
+        for (size_t c = 0; c < columns.size(); ++c) {
+            if (columns[c].name == name) return c;
+        }
+        throw InvalidInputException("Unknown column " + name);
+    }
+    
+    // Read only the requested columns of one row group
+    vector<ColumnValues> readRowGroup(size_t group, const vector<size_t>& projection) {
+        const RowGroupInfo& info = rowGroups.at(group);
+        vector<ColumnValues> result;
+        string data;
+        for (size_t column : projection) {
+            const ChunkInfo& chunk = info.chunks.at(column);
+            data.resize(chunk.length);
+            in.seekg(chunk.offset);
+            if (chunk.length > 0 && !in.read(&data[0], chunk.length)) {
+                throw FileOperationException("Failed to read column " + columns[column].name);
+            }
+            result.push_back(decode(columns[column].type, data, info.rows));
+        }
+        return result;
+    }
+};
+
+// Adoption analytics over a snapshot of the tables. Pets and applications are
+// split into contiguous ranges, one per worker thread; each worker aggregates
+// into its own hash tables and the partial results are merged afterwards.
+// Per-applicant tables are sharded by username hash so shards merge in parallel.
+class AdoptionAnalytics {
+public:
+    struct Decisions {
+        size_t approved = 0;
+        size_t decided = 0;
+    };
+    
+    struct Result {
+        map<long long, size_t> adoptionsPerWeek;            // Monday (days since epoch) -> approvals
+        map<string, pair<size_t, size_t>> breeds;           // breed -> (pets listed, adoptions)
+        vector<unordered_map<string, Decisions>> applicants; // disjoint shards by username
+        size_t applications = 0;
+        size_t approved = 0;
+        size_t rejected = 0;
+        size_t timedDecisions = 0;          // decisions with both timestamps known
+        double decisionSeconds = 0;
+        unsigned threads = 1;
+        double elapsedMs = 0;
+        
+        size_t applicantCount() const {
+            size_t count = 0;
+            for (const auto& shard : applicants) count += shard.size();
+            return count;
+        }
+    };
+    
+    // threads = 0 uses every hardware thread; small tables run on fewer
+    static Result compute(const PetTable& pets, const ApplicationTable& applications,
+                          unsigned threads = 0) {
+        auto started = chrono::steady_clock::now();
+        if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+        size_t largest = max(pets.size(), applications.size());
+        threads = static_cast<unsigned>(min<size_t>(threads, max<size_t>(1, largest / MIN_PARTITION)));
+        
+        // Pets: ID -> breed for the join, and pets listed per breed
+        vector<unordered_map<int, string>> petBreeds(threads);
+        vector<unordered_map<string, size_t>> listed(threads);
+        parallelFor(pets, threads, [&](unsigned part, PetTable::const_iterator it, PetTable::const_iterator end) {
+            for (; it != end; ++it) {
+                petBreeds[part][it->getID()] = it->getBreed();
+                listed[part][it->getBreed()]++;
+            }
+        });
+        for (unsigned part = 1; part < threads; ++part) {
+            petBreeds[0].insert(petBreeds[part].begin(), petBreeds[part].end());
+            unordered_map<int, string>().swap(petBreeds[part]);
+        }
+        const unordered_map<int, string>& breedOf = petBreeds[0];
+        
+        // Applications: one partial result per thread
+        vector<Partial> partials(threads);
+        for (auto& partial : partials) partial.applicants.resize(threads);
+        parallelFor(applications, threads,
+                    [&](unsigned part, ApplicationTable::const_iterator it, ApplicationTable::const_iterator end) {
+            Partial& partial = partials[part];
+            hash<string> hasher;
+            for (; it != end; ++it) {
+                partial.applications++;
+                const string& status = it->getStatus();
+                bool approved = status == "Approved";
+                if (!approved && status != "Rejected") continue;
+                
+                Decisions& decisions = partial.applicants[hasher(it->getUsername()) % partial.applicants.size()]
+                                                         [it->getUsername()];
+                decisions.decided++;
+                if (it->getSubmittedAt() > 0 && it->getDecidedAt() >= it->getSubmittedAt()) {
+                    partial.timedDecisions++;
+                    partial.decisionSeconds += difftime(it->getDecidedAt(), it->getSubmittedAt());
+                }
+                if (!approved) {
+                    partial.rejected++;
+                    continue;
+                }
+                decisions.approved++;
+                partial.approved++;
+                if (it->getDecidedAt() > 0) {
+                    partial.adoptionsPerWeek[weekStart(it->getDecidedAt())]++;
+                }
+                auto breed = breedOf.find(it->getPetID());
+                partial.breedAdoptions[breed == breedOf.end() ? "Unknown" : breed->second]++;
+            }
+        });
+        
+        // Merge: shard i of every partial is folded by thread i
+        Result result;
+        result.threads = threads;
+        result.applicants.resize(threads);
+        vector<thread> workers;
+        for (unsigned shard = 0; shard < threads; ++shard) {
+            auto mergeShard = [&result, &partials, shard]() {
+                unordered_map<string, Decisions>& merged = result.applicants[shard];
+                merged.swap(partials[0].applicants[shard]);
+                for (size_t part = 1; part < partials.size(); ++part) {
+                    for (const auto& entry : partials[part].applicants[shard]) {
+                        Decisions& decisions = merged[entry.first];
+                        decisions.approved += entry.second.approved;
+                        decisions.decided += entry.second.decided;
+                    }
+                }
+            };
+            if (shard + 1 == threads) mergeShard();
+            else workers.push_back(thread(mergeShard));
+        }
+        for (auto& worker : workers) worker.join();
+        
+        for (unsigned part = 0; part < threads; ++part) {
+            for (const auto& entry : listed[part]) result.breeds[entry.first].first += entry.second;
+        }
+        for (const auto& partial : partials) {
+            result.applications += partial.applications;
+            result.approved += partial.approved;
+            result.rejected += partial.rejected;
+            result.timedDecisions += partial.timedDecisions;
+            result.decisionSeconds += partial.decisionSeconds;
+            for (const auto& entry : partial.adoptionsPerWeek) result.adoptionsPerWeek[entry.first] += entry.second;
+            for (const auto& entry : partial.breedAdoptions) result.breeds[entry.first].second += entry.second;
+        }
+        result.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        return result;
+    }
+    
+    // Monday of the week holding t, in days since the epoch (a Thursday)
+    static long long weekStart(time_t t) {
+        long long days = static_cast<long long>(t) / 86400;
+        return (days + 3) / 7 * 7 - 3;
+    }
+    
+private:
+    static const size_t MIN_PARTITION = 1 << 16;    // records per thread worth the thread
+    
+    struct Partial {
+        size_t applications = 0;
+        size_t approved = 0;
+        size_t rejected = 0;
+        size_t timedDecisions = 0;
+        double decisionSeconds = 0;
+        unordered_map<long long, size_t> adoptionsPerWeek;
+        unordered_map<string, size_t> breedAdoptions;
+        vector<unordered_map<string, Decisions>> applicants;
+    };
+    
+    // Run work(part, begin, end) over `threads` contiguous ranges of the table,
+    // the last range on the calling thread
+    template <typename Table, typename Work>
+    static void parallelFor(const Table& table, unsigned threads, Work work) {
+        vector<thread> workers;
+        size_t step = (table.size() + threads - 1) / threads;
+        for (unsigned part = 0; part < threads; ++part) {
+            size_t begin = min(table.size(), part * step);
+            size_t end = min(table.size(), begin + step);
+            typename Table::const_iterator first(&table, begin), last(&table, end);
+            if (part + 1 == threads) work(part, first, last);
+            else workers.push_back(thread(work, part, first, last));
+        }
+        for (auto& worker : workers) worker.join();
+    }
+};
+
+PetAdoptionSystem& PetAdoptionSystem::getInstance() {
+    return ShelterRegistry::getInstance().open("default", ".");
+}
+
+// Validation functions
+// Only ASCII letters, digits and single spaces
+bool hasNameCharacters(const string& text) {
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        bool alphanumeric = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+        if (!alphanumeric && c != ' ') return false;
+        if (c == ' ' && i > 0 && text[i-1] == ' ') return false;
+    }
+    return true;
+}
+
+bool isValidUsername(const string& username) {
+    if (username.length() < 4 || username.length() > 20) return false;
+    return hasNameCharacters(username);
+}
+
+bool isValidPassword(const string& password) {
+    return !password.empty();
+}
+
+bool isValidName(const string& name) {
+    if (name.empty()) return false;
+    return hasNameCharacters(name);
+}
+
+bool isValidBreed(const string& breed) {
+    return isValidName(breed);
+}
+
+bool isValidDescription(const string& description) {
+    if (description.length() > 300) return false;
+    for (char c : description)
+        if (!isprint(static_cast<unsigned char>(c))) return false;
+    return true;
+}
+
+bool validateYesNo(const string& input) {
+    if (input != "Y" && input != "y") {
+        cout << "Invalid input. Please input only Y or y.\n";
+        return false;
+    }
+    return true;
+}
+
+// JSON Lines exchange: one flat JSON object per line. The reader parses a
+// line in a single pass into reused buffers; the writer escapes strings and
+// writes through a buffer. Both hold one record at a time.
+class JsonLineReader {
+public:
+    enum ValueType { STRING, NUMBER, BOOLEAN, NULL_VALUE };
+    struct Field {
+        string key;
+        string value;
+        ValueType type;
+    };
+    
+private:
+    vector<Field> fields;
+    size_t fieldCount = 0;
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    string error;
+    
+    void skipSpace() {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')) ++pos;
+    }
+    
+    bool fail(const char* message) {
+        error = message;
+        return false;
+    }
+    
+    static void appendUtf8(string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+    
+    bool parseHex4(uint32_t& code) {
+        if (end - pos < 4) return false;
+        code = 0;
+        for (int i = 0; i < 4; ++i, ++pos) {
+            char c = *pos;
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+    
+    // Parse a string starting at the opening quote into out
+    bool parseString(string& out) {
+        out.clear();
+        ++pos;
+        while (pos < end) {
+            // Copy unescaped runs in one append
+            const char* run = pos;
+            while (pos < end && *pos != '"' && *pos != '\\' && static_cast<unsigned char>(*pos) >= 0x20) ++pos;
+            out.append(run, pos - run);
+            if (pos == end) break;
+            char c = *pos++;
+            if (c == '"') return true;
+            if (c != '\\') return fail("control character in string");
+            if (pos == end) break;
+            switch (*pos++) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t code;
+                    if (!parseHex4(code)) return fail("invalid \\u escape");
+                    if (code >= 0xd800 && code < 0xdc00) {
+                        uint32_t low;
+                        if (end - pos < 6 || pos[0] != '\\' || pos[1] != 'u') return fail("unpaired surrogate");
+                        pos += 2;
+                        if (!parseHex4(low) || low < 0xdc00 || low > 0xdfff) return fail("unpaired surrogate");
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    } else if (code >= 0xdc00 && code < 0xe000) {
+                        return fail("unpaired surrogate");
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default:
+                    return fail("invalid escape");
+            }
+        }
+        return fail("unterminated string");
+    }
+    
+    bool parseLiteral(const char* literal, Field& field, ValueType type) {
+        size_t length = strlen(literal);
+        if (static_cast<size_t>(end - pos) < length || memcmp(pos, literal, length) != 0) {
+            return fail("invalid value");
+        }
+        field.value.assign(pos, length);
+        field.type = type;
+        pos += length;
+        return true;
+    }
+    
+    bool parseValue(Field& field) {
+        if (pos == end) return fail("missing value");
+        char c = *pos;
+        if (c == '"') {
+            field.type = STRING;
+            return parseString(field.value);
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            const char* start = pos;
+            if (*pos == '-') ++pos;
+            while (pos < end && ((*pos >= '0' && *pos <= '9') || *pos == '.' || *pos == 'e' ||
+                                 *pos == 'E' || *pos == '+' || *pos == '-')) ++pos;
+            field.value.assign(start, pos - start);
+            field.type = NUMBER;
+            return true;
+        }
+        if (c == 't') return parseLiteral("true", field, BOOLEAN);
+        if (c == 'f') return parseLiteral("false", field, BOOLEAN);
+        if (c == 'n') return parseLiteral("null", field, NULL_VALUE);
+        if (c == '{' || c == '[') return fail("nested values are not supported");
+        return fail("invalid value");
+    }
+    
+public:
+    // Parse one line; on failure errorMessage() says why
+    bool parse(const string& line) {
+        pos = line.data();
+        end = pos + line.size();
+        fieldCount = 0;
+        skipSpace();
+        if (pos == end || *pos != '{') return fail("expected '{'");
+        ++pos;
+        skipSpace();
+        if (pos < end && *pos == '}') {
+            ++pos;
+        } else {
+            while (true) {
+                if (fieldCount == fields.size()) fields.push_back(Field());
+                Field& field = fields[fieldCount];
+                skipSpace();
+                if (pos == end || *pos != '"') return fail("expected a key");
+                if (!parseString(field.key)) return false;
+                skipSpace();
+                if (pos == end || *pos != ':') return fail("expected ':'");
+                ++pos;
+                skipSpace();
+                if (!parseValue(field)) return false;
+                fieldCount++;
+                skipSpace();
+                if (pos < end && *pos == ',') { ++pos; continue; }
+                if (pos < end && *pos == '}') { ++pos; break; }
+                return fail("expected ',' or '}'");
+            }
+        }
+        skipSpace();
+        if (pos != end) return fail("unexpected text after object");
+        return true;
+    }
+    
+    const string& errorMessage() const { return error; }
+    
+    const Field* find(const char* key) const {
+        for (size_t i = 0; i < fieldCount; ++i) {
+            if (fields[i].key == key) return &fields[i];
+        }
+        return nullptr;
+    }
+    
+    // Typed accessors: false if the field is missing or has the wrong type
+    bool getString(const char* key, const string*& value) const {
+        const Field* field = find(key);
+        if (!field || field->type != STRING) return false;
+        value = &field->value;
+        return true;
+    }
+    
+    bool getInteger(const char* key, long long& value) const {
+        const Field* field = find(key);
+        if (!field || field->type != NUMBER) return false;
+        const string& text = field->value;
+        size_t i = text[0] == '-' ? 1 : 0;
+        if (i == text.size() || text.size() - i > 18) return false;
+        long long result = 0;
+        for (; i < text.size(); ++i) {
+            if (text[i] < '0' || text[i] > '9') return false;
+            result = result * 10 + (text[i] - '0');
+        }
+        value = text[0] == '-' ? -result : result;
+        return true;
+    }
+    
+    bool getBool(const char* key, bool& value) const {
+        const Field* field = find(key);
+        if (!field || field->type != BOOLEAN) return false;
+        value = field->value == "true";
+        return true;
+    }
+};
+
+class JsonLineWriter {
+private:
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    ostream& out;
+    string buffer;
+    bool firstField = true;
+    
+    void key(const char* name) {
+        buffer += firstField ? "\"" : ",\"";
+        buffer += name;
+        buffer += "\":";
+        firstField = false;
+    }
+    
+public:
+    explicit JsonLineWriter(ostream& stream) : out(stream) {
+        buffer.reserve(BUFFER_SIZE + 1024);
+    }
+    
+    ~JsonLineWriter() { flush(); }
+    
+    void beginObject() {
+        buffer += '{';
+        firstField = true;
+    }
+    
+    void endObject() {
+        buffer += "}\n";
+        if (buffer.size() >= BUFFER_SIZE) flush();
+    }
+    
+    void field(const char* name, const string& value) {
+        static const char hex[] = "0123456789abcdef";
+        key(name);
+        buffer += '"';
+        size_t run = 0;
+        for (size_t i = 0; i < value.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(value[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            buffer.append(value, run, i - run);
+            run = i + 1;
+            switch (c) {
+                case '"': buffer += "\\\""; break;
+                case '\\': buffer += "\\\\"; break;
+                case '\n': buffer += "\\n"; break;
+                case '\r': buffer += "\\r"; break;
+                case '\t': buffer += "\\t"; break;
+                default:
+                    buffer += "\\u00";
+                    buffer += hex[c >> 4];
+                    buffer += hex[c & 0xf];
+            }
+        }
+        buffer.append(value, run, string::npos);
+        buffer += '"';
+    }
+    
+    void field(const char* name, long long value) {
+        key(name);
+        buffer += to_string(value);
+    }
+    
+    void field(const char* name, bool value) {
+        key(name);
+        buffer += value ? "true" : "false";
+    }
+    
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+};
+
+// JSON values: roles as "admin" or "user", dates as "YYYY-MM-DD", integers
+// range-checked on read
+template <typename T>
+typename enable_if<is_integral<T>::value>::type writeJson(JsonLineWriter& writer, const char* key, T value) {
+    writer.field(key, static_cast<long long>(value));
+}
+
+inline void writeJson(JsonLineWriter& writer, const char* key, bool value) { writer.field(key, value); }
+inline void writeJson(JsonLineWriter& writer, const char* key, const string& value) { writer.field(key, value); }
+
+inline void writeJson(JsonLineWriter& writer, const char* key, Role value) {
+    writer.field(key, string(value == Role::ADMIN ? "admin" : "user"));
+}
+
+inline void writeJson(JsonLineWriter& writer, const char* key, Date value) {
+    writer.field(key, value.toString());
+}
+
+template <typename T>
+typename enable_if<is_integral<T>::value, bool>::type
+readJson(const JsonLineReader& reader, const char* key, T& value) {
+    long long number;
+    if (!reader.getInteger(key, number)) return false;
+    if (number < 0 ? number < static_cast<long long>(numeric_limits<T>::min())
+                   : static_cast<unsigned long long>(number) > static_cast<unsigned long long>(numeric_limits<T>::max())) {
+        return false;
+    }
+    value = static_cast<T>(number);
+    return true;
+}
+
+inline bool readJson(const JsonLineReader& reader, const char* key, bool& value) {
+    return reader.getBool(key, value);
+}
+
+inline bool readJson(const JsonLineReader& reader, const char* key, string& value) {
+    const string* text;
+    if (!reader.getString(key, text)) return false;
+    value = *text;
+    return true;
+}
+
+inline bool readJson(const JsonLineReader& reader, const char* key, Role& value) {
+    const string* text;
+    if (!reader.getString(key, text) || (*text != "admin" && *text != "user")) return false;
+    value = *text == "admin" ? Role::ADMIN : Role::USER;
+    return true;
+}
+
+inline bool readJson(const JsonLineReader& reader, const char* key, Date& value) {
+    const string* text;
+    return reader.getString(key, text) && Date::parse(text->data(), text->data() + text->size(), value);
+}
+
+// One JSON object per record, keyed by field name; internal fields are
+// neither written nor read
+template <typename Record, typename List = typename Record::Fields>
+class JsonCodec;
+
+template <typename Record, typename... Fields>
+class JsonCodec<Record, FieldList<Fields...>> {
+private:
+    template <typename Field>
+    static void encodeField(JsonLineWriter& writer, const Record& record) {
+        if (!(Field::flags & FIELD_INTERNAL)) writeJson(writer, Field::name(), Field::get(record));
+    }
+    
+    // Records the first field present with the wrong type or range
+    template <typename Field>
+    static void decodeField(const JsonLineReader& reader, Record& record, const char*& invalid) {
+        if (invalid || (Field::flags & FIELD_INTERNAL) || !reader.find(Field::name())) return;
+        if (!readJson(reader, Field::name(), Field::ref(record))) invalid = Field::name();
+    }
+    
+public:
+    static void encode(JsonLineWriter& writer, const Record& record) {
+        writer.beginObject();
+        int expand[] = {0, (encodeField<Fields>(writer, record), 0)...};
+        (void)expand;
+        writer.endObject();
+    }
+    
+    // Fields missing from the object keep their current values. Returns the
+    // name of the first invalid field, or nullptr if all are valid.
+    static const char* decode(const JsonLineReader& reader, Record& record) {
+        const char* invalid = nullptr;
+        int expand[] = {0, (decodeField<Fields>(reader, record, invalid), 0)...};
+        (void)expand;
+        return invalid;
+    }
+};
+
+void exportPetsJsonl(const PetTable& pets, ostream& out) {
+    JsonLineWriter writer(out);
+    for (const auto& pet : pets) JsonCodec<Pet>::encode(writer, pet);
+}
+
+void exportApplicationsJsonl(const ApplicationTable& applications, ostream& out) {
+    JsonLineWriter writer(out);
+    for (const auto& app : applications) JsonCodec<Application>::encode(writer, app);
+}
+
+// Passwords are not exported; see importUsersJsonl()
+void exportUsersJsonl(const vector<unique_ptr<User>>& users, ostream& out) {
+    JsonLineWriter writer(out);
+    for (const auto& user : users) JsonCodec<User>::encode(writer, *user);
+}
+
+// Outcome of an import; the first MAX_ERRORS rejected lines are kept for display
+struct ImportResult {
+    static const size_t MAX_ERRORS = 100;
+    size_t imported = 0;
+    size_t rejected = 0;
+    vector<string> errors;
+    
+    void reject(size_t lineNumber, const string& reason) {
+        rejected++;
+        if (errors.size() < MAX_ERRORS) errors.push_back("Line " + to_string(lineNumber) + ": " + reason);
+    }
+    
+    void print(const string& records) const {
+        cout << imported << " " << records << " imported, " << rejected << " rejected.\n";
+        for (const auto& error : errors) cout << "  " << error << "\n";
+        if (rejected > errors.size()) cout << "  ... and " << rejected - errors.size() << " more\n";
+    }
+};
+
+// Read records line by line, calling importRecord(reader) for each parsed
+// line; it returns an empty string or the reason the record was rejected
+template <typename ImportRecord>
+ImportResult importJsonLines(istream& in, ImportRecord importRecord) {
+    ImportResult result;
+    JsonLineReader reader;
+    string line;
+    size_t lineNumber = 0;
+    while (getline(in, line)) {
+        lineNumber++;
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        if (!reader.parse(line)) {
+            result.reject(lineNumber, reader.errorMessage());
+            continue;
+        }
+        string reason = importRecord(reader);
+        if (reason.empty()) result.imported++;
+        else result.reject(lineNumber, reason);
+    }
+    return result;
+}
+
+// Pets are validated like the Add Pet form. Records from older exports give an
+// "age" in years instead of "birth_date". Returns the reason a record is
+// invalid, or an empty string.
+string decodePetRecord(const JsonLineReader& record, const unordered_set<int>& shelterIDs, Pet& pet) {
+    const char* invalid = JsonCodec<Pet>::decode(record, pet);
+    if (invalid) return string("invalid ") + invalid;
+    if (!isValidName(pet.getName())) return "invalid or missing name";
+    if (!isValidBreed(pet.getBreed())) return "invalid or missing breed";
+    if (record.find("birth_date")) {
+        if (pet.getBirthDate().days > Date::today().days) return "birth_date is in the future";
+    } else {
+        int age;
+        if (!record.find("age") || !readJson(record, "age", age) || age < 0 || age > 1000) {
+            return "invalid or missing birth_date";
+        }
+        pet.setBirthDate(Date::today().monthsBefore(age * 12));
+    }
+    if (pet.getShelterID() != 0 && !shelterIDs.count(pet.getShelterID())) return "unknown shelter_id";
+    if (!isValidDescription(pet.getDescription())) return "invalid description";
+    return "";
+}
+
+// Names already in use are rejected
+ImportResult importPetsJsonl(PetAdoptionSystem& system, istream& in) {
+    unordered_set<int> shelterIDs;
+    for (const auto& shelter : system.getAllShelters()) shelterIDs.insert(shelter.getID());
+    
+    system.beginImport("Import pets");
+    ImportResult result = importJsonLines(in, [&](const JsonLineReader& record) -> string {
+        Pet pet("", "", Date(), false);
+        string reason = decodePetRecord(record, shelterIDs, pet);
+        if (!reason.empty()) return reason;
+        if (system.hasPet(pet.getName())) return "a pet named " + pet.getName() + " already exists";
+        
+        system.importPet(pet);
+        return "";
+    });
+    system.finishImport(PETS_TABLE);
+    return result;
+}
+
+// Applications get new IDs in this system; the status defaults to Pending and
+// the submission time to now. The applicant and the pet must exist, and an
+// approved application marks its pet adopted.
+ImportResult importApplicationsJsonl(PetAdoptionSystem& system, istream& in) {
+    unordered_set<string> usernames;
+    for (const auto& user : system.getAllUsers()) usernames.insert(user->getUsername());
+    
+    system.beginImport("Import applications");
+    bool adoptions = false;
+    ImportResult result = importJsonLines(in, [&](const JsonLineReader& record) -> string {
+        Application app(0, "", "");
+        const char* invalid = JsonCodec<Application>::decode(record, app);
+        if (invalid) return string("invalid ") + invalid;
+        if (!isValidUsername(app.getUsername())) return "invalid or missing username";
+        if (!isValidName(app.getPetName())) return "invalid or missing pet_name";
+        if (!usernames.count(app.getUsername())) return "unknown user " + app.getUsername();
+        if (!system.hasPet(app.getPetName())) return "unknown pet " + app.getPetName();
+        const string& status = app.getStatus();
+        if (status != "Pending" && status != "Approved" && status != "Rejected") return "invalid status";
+        if (app.getSubmittedAt() < 0) return "invalid submitted_at";
+        if (app.getDecidedAt() < 0) return "invalid decided_at";
+        if (!system.importApplication(app.getUsername(), app.getPetName(), status, app.getSubmittedAt(),
+                                      app.getDecidedAt())) {
+            return app.getUsername() + " already has an active application for " + app.getPetName();
+        }
+        if (status == "Approved") adoptions = true;
+        return "";
+    });
+    system.finishImport(APPLICATIONS_TABLE | (adoptions ? PETS_TABLE : 0));
+    return result;
+}
+
+// Users without a "password", such as those from exportUsersJsonl(), are
+// imported with none and stay locked out until an admin sets one
+ImportResult importUsersJsonl(PetAdoptionSystem& system, istream& in) {
+    unordered_set<string> usernames;
+    for (const auto& user : system.getAllUsers()) usernames.insert(user->getUsername());
+    
+    ImportResult result = importJsonLines(in, [&](const JsonLineReader& record) -> string {
+        const string* username;
+        const string* password = nullptr;
+        const string* role = nullptr;
+        if (!record.getString("username", username) || !isValidUsername(*username)) {
+            return "invalid or missing username";
+        }
+        if (record.find("password") && (!record.getString("password", password) || !isValidPassword(*password))) {
+            return "invalid password";
+        }
+        if (record.find("role") && (!record.getString("role", role) || (*role != "admin" && *role != "user"))) {
+            return "role must be \"admin\" or \"user\"";
+        }
+        if (!usernames.insert(*username).second) return "username " + *username + " already exists";
+        
+        string pwd = password ? *password : string();
+        if (role && *role == "admin") system.importUser(unique_ptr<User>(new Admin(*username, pwd)));
+        else system.importUser(unique_ptr<User>(new RegularUser(*username, pwd)));
+        return "";
+    });
+    system.finishImport(USERS_TABLE);
+    return result;
+}
+
+// Write a quoted CSV field, doubling any quotes inside it, so parseCsvLine
+// reads it back unchanged
+void writeCsvField(ostream& out, const string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"') out << '"';
+        out << c;
+    }
+    out << '"';
+}
+
+// Split one CSV line into fields. Quoted fields may contain commas and
+// doubled quotes; a field cannot span lines.
+bool parseCsvLine(const string& line, vector<string>& fields, string& error) {
+    fields.clear();
+    size_t pos = 0;
+    size_t length = line.size();
+    if (length > 0 && line[length - 1] == '\r') length--;
+    while (true) {
+        fields.push_back(string());
+        string& field = fields.back();
+        if (pos < length && line[pos] == '"') {
+            pos++;
+            while (true) {
+                size_t quote = line.find('"', pos);
+                if (quote == string::npos || quote >= length) {
+                    error = "unterminated quoted field";
+                    return false;
+                }
+                field.append(line, pos, quote - pos);
+                pos = quote + 1;
+                if (pos < length && line[pos] == '"') {
+                    field += '"';
+                    pos++;
+                } else {
+                    break;
+                }
+            }
+            if (pos < length && line[pos] != ',') {
+                error = "text after closing quote";
+                return false;
+            }
+        } else {
+            size_t comma = line.find(',', pos);
+            if (comma == string::npos || comma > length) comma = length;
+            field.assign(line, pos, comma - pos);
+            pos = comma;
+        }
+        if (pos >= length) return true;
+        pos++;  // skip the comma
+    }
+}
+
+bool parseYesNo(const string& text, bool& value) {
+    string lower;
+    for (char c : text) lower += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    if (lower == "1" || lower == "y" || lower == "yes" || lower == "true") value = true;
+    else if (lower == "0" || lower == "n" || lower == "no" || lower == "false" || lower.empty()) value = false;
+    else return false;
+    return true;
+}
+
+// Bulk pet intake from CSV. The first line names the columns: name, breed and
+// age (or birth_date; either takes a date or an age) are required;
+// vaccinated, shelter_id and description are optional.
+// Rows are read in chunks, parsed and validated in parallel, then inserted in
+// file order. Names already in use, including by earlier rows, are rejected
+// as in the JSON Lines import. The whole import is one undoable change saved
+// once.
+class PetCsvImporter {
+private:
+    static const size_t CHUNK_ROWS = 16 * 1024;
+    static const size_t MIN_ROWS_PER_THREAD = 1024;
+    
+    enum Column { NAME, BREED, AGE, VACCINATED, SHELTER_ID, DESCRIPTION, COLUMN_COUNT };
+    
+    struct Row {
+        size_t lineNumber;
+        string line;
+        bool valid;
+        string error;
+        Pet pet;
+        
+        Row() : lineNumber(0), valid(false), pet("", "", Date(), false) {}
+    };
+    
+    PetAdoptionSystem& system;
+    vector<int> columnFor;      // CSV field index of each Column, -1 if absent
+    size_t fieldCount = 0;
+    unordered_set<int> shelterIDs;
+    
+    void readHeader(const string& line) {
+        const char* names[COLUMN_COUNT] = {"name", "breed", "age", "vaccinated", "shelter_id", "description"};
+        vector<string> fields;
+        string error;
+        if (!parseCsvLine(line, fields, error)) throw InvalidInputException("Invalid CSV header: " + error);
+        columnFor.assign(COLUMN_COUNT, -1);
+        for (size_t i = 0; i < fields.size(); ++i) {
+            int column = -1;
+            for (int c = 0; c < COLUMN_COUNT; ++c) {
+                if (fields[i] == names[c]) column = c;
+            }
+            if (fields[i] == "birth_date") column = AGE;
+            if (column == -1) throw InvalidInputException("Unknown CSV column " + fields[i]);
+            if (columnFor[column] != -1) throw InvalidInputException("Duplicate CSV column " + fields[i]);
+            columnFor[column] = static_cast<int>(i);
+        }
+        for (int c = NAME; c <= AGE; ++c) {
+            if (columnFor[c] == -1) throw InvalidInputException(string("Missing CSV column ") + names[c]);
+        }
+        fieldCount = fields.size();
     }
     
-    void deleteUser(size_t index) {
-        if (index >= users.size()) {
-            throw out_of_range("Invalid user index");
+    // Runs on worker threads: touches only the row and read-only state
+    void validate(Row& row) const {
+        vector<string> fields;
+        if (!parseCsvLine(row.line, fields, row.error)) return;
+        if (fields.size() != fieldCount) {
+            row.error = "expected " + to_string(fieldCount) + " fields, found " + to_string(fields.size());
+            return;
         }
-        users.erase(users.begin() + index);
-        saveUsersToFile();
+        const string& name = fields[columnFor[NAME]];
+        const string& breed = fields[columnFor[BREED]];
+        Date birthDate;
+        bool vaccinated = false;
+        int shelterID = 0;
+        if (!isValidName(name)) { row.error = "invalid name"; return; }
+        if (!isValidBreed(breed)) { row.error = "invalid breed"; return; }
+        if (!parseAgeText(fields[columnFor[AGE]], birthDate)) { row.error = "invalid age"; return; }
+        if (columnFor[VACCINATED] != -1 && !parseYesNo(fields[columnFor[VACCINATED]], vaccinated)) {
+            row.error = "invalid vaccinated value";
+            return;
+        }
+        if (columnFor[SHELTER_ID] != -1 && !fields[columnFor[SHELTER_ID]].empty()) {
+            const string& text = fields[columnFor[SHELTER_ID]];
+            if (text.size() > 9 || text.find_first_not_of("0123456789") != string::npos ||
+                (stoi(text) != 0 && !shelterIDs.count(stoi(text)))) {
+                row.error = "unknown shelter_id";
+                return;
+            }
+            shelterID = stoi(text);
+        }
+        row.pet = Pet(name, breed, birthDate, vaccinated, shelterID);
+        if (columnFor[DESCRIPTION] != -1) {
+            if (!isValidDescription(fields[columnFor[DESCRIPTION]])) { row.error = "invalid description"; return; }
+            row.pet.setDescription(fields[columnFor[DESCRIPTION]]);
+        }
+        row.valid = true;
     }
     
-    void updateUser(size_t index, const string& username, const string& password) {
-        if (index >= users.size()) {
-            throw out_of_range("Invalid user index");
+    void processChunk(vector<Row>& rows, size_t count, ImportResult& result) {
+        unsigned threads = max(1u, thread::hardware_concurrency());
+        threads = static_cast<unsigned>(min<size_t>(threads, max<size_t>(1, count / MIN_ROWS_PER_THREAD)));
+        size_t step = (count + threads - 1) / threads;
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            size_t begin = min(count, t * step), end = min(count, begin + step);
+            auto work = [this, &rows, begin, end]() {
+                for (size_t i = begin; i < end; ++i) validate(rows[i]);
+            };
+            if (t + 1 == threads) work();
+            else workers.push_back(thread(work));
+        }
+        for (auto& worker : workers) worker.join();
+        
+        for (size_t i = 0; i < count; ++i) {
+            Row& row = rows[i];
+            if (!row.valid) {
+                result.reject(row.lineNumber, row.error);
+            } else if (system.hasPet(row.pet.getName())) {
+                result.reject(row.lineNumber, "a pet named " + row.pet.getName() + " already exists");
+            } else {
+                system.importPet(row.pet);
+                result.imported++;
+            }
         }
-        users[index]->setUsername(username);
-        users[index]->setPassword(password);
-        saveUsersToFile();
     }
     
-    const vector<unique_ptr<User>>& getAllUsers() const { return users; }
+public:
+    explicit PetCsvImporter(PetAdoptionSystem& sys) : system(sys) {
+        for (const auto& shelter : system.getAllShelters()) shelterIDs.insert(shelter.getID());
+    }
     
-    // Friend classes for protected access
-    friend class Admin;
-    friend class RegularUser;
+    ImportResult run(istream& in) {
+        string line;
+        if (!getline(in, line)) throw InvalidInputException("The CSV file is empty");
+        readHeader(line);
+        
+        ImportResult result;
+        system.beginImport("Import pets from CSV");
+        vector<Row> rows(CHUNK_ROWS);
+        size_t count = 0, lineNumber = 1;
+        while (getline(in, rows[count].line)) {
+            lineNumber++;
+            if (rows[count].line.find_first_not_of(" \t\r") == string::npos) continue;
+            rows[count].lineNumber = lineNumber;
+            rows[count].valid = false;
+            rows[count].error.clear();
+            if (++count == CHUNK_ROWS) {
+                processChunk(rows, count, result);
+                count = 0;
+            }
+        }
+        processChunk(rows, count, result);
+        system.finishImport(PETS_TABLE);
+        return result;
+    }
 };
 
-// Initialize singleton instance
-PetAdoptionSystem* PetAdoptionSystem::instance = nullptr;
-
-// Validation functions
-bool isValidUsername(const string& username) {
-    if (username.length() < 4 || username.length() > 20) return false;
-    if (!regex_match(username, regex("^[A-Za-z0-9 ]+$"))) return false;
-    for (size_t i = 1; i < username.size(); ++i)
-        if (isspace(username[i]) && isspace(username[i-1])) return false;
-    return true;
-}
-
-bool isValidPassword(const string& password) {
-    return !password.empty();
-}
-
-bool isValidName(const string& name) {
-    if (name.empty()) return false;
-    if (!regex_match(name, regex("^[A-Za-z0-9 ]+$"))) return false;
-    for (size_t i = 1; i < name.size(); ++i)
-        if (isspace(name[i]) && isspace(name[i-1])) return false;
-    return true;
-}
-
-bool isValidBreed(const string& breed) {
-    return isValidName(breed);
+// Run a JSON Lines import or export of one table ("pets", "applications" or
+// "users") and report the outcome
+int runJsonLinesTransfer(PetAdoptionSystem& system, bool import, const string& table, const string& path) {
+    if (table != "pets" && table != "applications" && table != "users") {
+        throw InvalidInputException("Unknown table " + table + " (use pets, applications or users)");
+    }
+    if (!import) {
+        ofstream out(path, ios::binary);
+        if (!out.is_open()) {
+            throw FileOperationException("Failed to open " + path + " for writing");
+        }
+        if (table == "pets") exportPetsJsonl(system.snapshotPets(), out);
+        else if (table == "applications") exportApplicationsJsonl(system.snapshotApplications(), out);
+        else exportUsersJsonl(system.getAllUsers(), out);
+        out.close();
+        if (!out) {
+            throw FileOperationException("Failed to write " + path);
+        }
+        cout << "Exported " << table << " to " << path << "\n";
+        return 0;
+    }
+    
+    ifstream in(path, ios::binary);
+    if (!in.is_open()) {
+        throw FileOperationException("Failed to open " + path);
+    }
+    ImportResult result = table == "pets" ? importPetsJsonl(system, in)
+                        : table == "applications" ? importApplicationsJsonl(system, in)
+                        : importUsersJsonl(system, in);
+    result.print(table);
+    return result.rejected == 0 ? 0 : 1;
 }
 
-bool validateYesNo(const string& input) {
-    if (input != "Y" && input != "y") {
-        cout << "Invalid input. Please input only Y or y.\n";
-        return false;
+// Throughput of the JSON Lines path on count generated pets: the export, the
+// parse and validation alone, and a full import including the save. The pets
+// are imported into the shelter, so run it against a scratch data directory.
+int runJsonLinesBenchmark(PetAdoptionSystem& system, size_t count) {
+    const char* breeds[] = {"Labrador", "Siamese", "Beagle", "Persian", "Poodle"};
+    PetTable pets;
+    for (size_t i = 0; i < count; ++i) {
+        Pet pet("Bench" + to_string(i), breeds[i % 5], Date::today().monthsBefore(static_cast<int>(i % 180)),
+                i % 2 == 0);
+        pet.setDescription("Calm pet " + to_string(i) + ", likes naps");
+        pets.push_back(pet);
     }
-    return true;
+    makeDirectory(system.getTempDirectory());
+    string path = system.getTempDirectory() + "/benchmark.jsonl";
+    auto started = chrono::steady_clock::now();
+    auto lap = [&]() {
+        auto now = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(now - started).count();
+        started = now;
+        return seconds;
+    };
+    
+    ofstream out(path, ios::binary);
+    exportPetsJsonl(pets, out);
+    out.close();
+    if (!out) {
+        throw FileOperationException("Failed to write " + path);
+    }
+    double exportSeconds = lap();
+    
+    unordered_set<int> shelterIDs;
+    for (const auto& shelter : system.getAllShelters()) shelterIDs.insert(shelter.getID());
+    ifstream parseIn(path, ios::binary);
+    ImportResult parsed = importJsonLines(parseIn, [&](const JsonLineReader& record) {
+        Pet pet("", "", Date(), false);
+        return decodePetRecord(record, shelterIDs, pet);
+    });
+    double parseSeconds = lap();
+    
+    ifstream importIn(path, ios::binary);
+    ImportResult imported = importPetsJsonl(system, importIn);
+    system.flush();
+    double importSeconds = lap();
+    
+    ifstream sized(path, ios::binary | ios::ate);
+    double megabytes = static_cast<double>(sized.tellg()) / (1 << 20);
+    sized.close();
+    remove(path.c_str());
+    cout << count << " pets, " << fixed << setprecision(0) << megabytes << " MB of JSON Lines\n"
+         << setprecision(2) << "export: " << exportSeconds << " s\n"
+         << "parse + validate: " << parseSeconds << " s (" << parsed.imported << " valid)\n"
+         << "full import and save: " << importSeconds << " s (" << imported.imported << " imported)\n";
+    cout << defaultfloat << setprecision(6);
+    return imported.rejected == 0 ? 0 : 1;
 }
 
 // SearchStrategy implementations
-vector<Pet> NameSearchStrategy::search(const vector<Pet>& pets) {
+vector<Pet> NameSearchStrategy::search(const PetTable& pets) {
     vector<Pet> results;
     for (const auto& pet : pets) {
         if (pet.getName().find(name) != string::npos) {
@@ -603,7 +6603,7 @@ vector<Pet> NameSearchStrategy::search(const vector<Pet>& pets) {
     return results;
 }
 
-vector<Pet> BreedSearchStrategy::search(const vector<Pet>& pets) {
+vector<Pet> BreedSearchStrategy::search(const PetTable& pets) {
     vector<Pet> results;
     for (const auto& pet : pets) {
         if (pet.getBreed().find(breed) != string::npos) {
@@ -613,139 +6613,859 @@ vector<Pet> BreedSearchStrategy::search(const vector<Pet>& pets) {
     return results;
 }
 
-vector<Pet> AgeRangeSearchStrategy::search(const vector<Pet>& pets) {
-    vector<Pet> results;
-    for (const auto& pet : pets) {
-        if (pet.getAge() >= minAge && pet.getAge() <= maxAge) {
-            results.push_back(pet);
+// File handling implementations
+
+// Write each record as a text line, in chunks rather than line by line
+template <typename Table>
+void writeRecordLines(ostream& out, const Table& records) {
+    const size_t CHUNK_SIZE = 64 * 1024;
+    string buffer;
+    for (const auto& record : records) {
+        record.serializeTo(buffer);
+        buffer += '\n';
+        if (buffer.size() >= CHUNK_SIZE) {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
         }
     }
-    return results;
+    out.write(buffer.data(), buffer.size());
 }
 
-// File handling implementations
 void PetAdoptionSystem::saveUsersToFile() {
-    ofstream outFile("users.dat");
+    migrator.markSaved("users.dat");
+    discardSavedFilters();
+    ofstream outFile(dataPath("users.dat"));
     if (!outFile.is_open()) {
         throw FileOperationException("Failed to open users file for writing");
     }
     
+    outFile << "SCHEMA:" << USERS_SCHEMA << "\n";
+    string buffer;
     for (const auto& user : users) {
-        outFile << user->getUsername() << ","
-                << user->getPassword() << ","
-                << static_cast<int>(user->getRole()) << "\n";
+        user->serializeTo(buffer);
+        buffer += '\n';
     }
+    outFile << buffer;
     outFile.close();
+    // A full save compacts the filter: removed and renamed users drop out
+    rebuildUserFilter();
     cout << "User credentials saved successfully.\n";
 }
 
 void PetAdoptionSystem::savePetsToFile() {
-    ofstream outFile("pets.dat");
+    migrator.markSaved("pets.dat");
+    discardSavedFilters();
+    ofstream outFile(dataPath("pets.dat"));
     if (!outFile.is_open()) {
         throw FileOperationException("Failed to open pets file for writing");
     }
     
-    for (const auto& pet : pets) {
-        outFile << pet.serialize() << "\n";
-    }
+    outFile << "SCHEMA:" << PETS_SCHEMA << "\n";
+    // The current version heads the file so it survives restarts
+    outFile << "VERSION:" << commitClock << "\n";
+    outFile << "NEXT_ID:" << nextPetID << "\n";
+    
+    writeRecordLines(outFile, pets);
     outFile.close();
+    // Every journaled edit is now part of pets.dat
+    pendingPetEdits.clear();
+    journaledPetEdits = 0;
+    remove(dataPath("pet_edits.dat").c_str());
+    rebuildPetFilter();
     cout << "Pets saved successfully.\n";
 }
 
 void PetAdoptionSystem::loadUsersFromFile() {
-    ifstream inFile("users.dat");
+    ifstream inFile(dataPath("users.dat"));
     if (!inFile.is_open()) {
         return; // File doesn't exist yet
     }
     
+    readSchemaHeader(inFile, "users.dat", USERS_SCHEMA);
     string line;
     int userCount = 0;
     while (getline(inFile, line)) {
-        size_t pos1 = line.find(',');
-        size_t pos2 = line.find(',', pos1+1);
-        if (pos1 == string::npos || pos2 == string::npos) continue;
-        
-        string username = line.substr(0, pos1);
-        string password = line.substr(pos1+1, pos2-pos1-1);
-        Role role = static_cast<Role>(stoi(line.substr(pos2+1)));
-        
-        if (role == Role::ADMIN) {
-            users.push_back(unique_ptr<User>(new Admin(username, password)));
-        } else {
-            users.push_back(unique_ptr<User>(new RegularUser(username, password)));
+        try {
+            users.push_back(User::deserialize(line));
+            userCount++;
+        } catch (const exception& e) {
+            cerr << "Error loading user: " << e.what() << "\n";
+            continue; // Skip invalid entries
         }
-        userCount++;
     }
     inFile.close();
     cout << userCount << " user(s) loaded from database.\n";
 }
 
 void PetAdoptionSystem::loadPetsFromFile() {
-    ifstream inFile("pets.dat");
+    ifstream inFile(dataPath("pets.dat"));
     if (!inFile.is_open()) {
         return; // File doesn't exist yet
     }
     
+    // Legacy files (schema 0) may lack the VERSION header and record versions
+    int schema = readSchemaHeader(inFile, "pets.dat", PETS_SCHEMA);
+    bool hasVersion = schema >= 4;
+    bool hasID = schema >= 6;
     string line;
+    uint64_t savedVersion = 0;
+    
+    // Header lines hold the current version and the next pet ID; older files
+    // start with a pet
+    bool pending = false;
     while (getline(inFile, line)) {
+        if (line.compare(0, 8, "VERSION:") == 0) {
+            savedVersion = stoull(line.substr(8));
+            commitClock = max(commitClock, savedVersion);
+            hasVersion = true;
+        } else if (line.compare(0, 8, "NEXT_ID:") == 0) {
+            nextPetID = max(nextPetID, stoi(line.substr(8)));
+        } else {
+            pending = true;
+            break;
+        }
+    }
+    
+    // Pets from files without ids are numbered by record, as the migrator
+    // numbers them
+    size_t records = 0;
+    while (pending || getline(inFile, line)) {
+        pending = false;
+        if (line.empty()) continue;
+        records++;
         try {
-            Pet pet = Pet::deserialize(line);
+            Pet pet = Pet::deserialize(line, hasVersion, hasID);
+            if (!hasID) pet.setID(static_cast<int>(records));
+            nextPetID = max(nextPetID, pet.getID() + 1);
             pets.push_back(pet);
         } catch (const exception& e) {
             cerr << "Error loading pet: " << e.what() << "\n";
             continue; // Skip invalid entries
         }
     }
-    inFile.close();
-    cout << pets.size() << " pets loaded from file.\n";
+    inFile.close();
+    loadPetEditsFromFile(savedVersion);
+    cout << pets.size() << " pets loaded from file.\n";
+}
+
+void PetAdoptionSystem::saveApplicationsToFile() {
+    migrator.markSaved("applications.dat");
+    ofstream outFile(dataPath("applications.dat"));
+    if (!outFile.is_open()) {
+        throw FileOperationException("Failed to open applications file for writing");
+    }
+    
+    outFile << "SCHEMA:" << APPLICATIONS_SCHEMA << "\n";
+    // Also save the next application ID and the current version
+    outFile << "NEXT_ID:" << nextAppID << "\n";
+    outFile << "VERSION:" << commitClock << "\n";
+    
+    writeRecordLines(outFile, applications);
+    outFile.close();
+    cout << "Applications saved successfully.\n";
+}
+
+void PetAdoptionSystem::loadApplicationsFromFile() {
+    ifstream inFile(dataPath("applications.dat"));
+    if (!inFile.is_open()) {
+        return; // File doesn't exist yet
+    }
+    
+    applications.clear();
+    readSchemaHeader(inFile, "applications.dat", APPLICATIONS_SCHEMA);
+    streampos start = inFile.tellg();
+    string line;
+    
+    // First record line should be the next ID
+    if (getline(inFile, line) && line.substr(0, 8) == "NEXT_ID:") {
+        nextAppID = stoi(line.substr(8));
+    } else {
+        // If not found, reset the file pointer to the first record
+        inFile.clear();
+        inFile.seekg(start);
+    }
+    
+    // Read all applications
+    while (getline(inFile, line)) {
+        if (line.compare(0, 8, "VERSION:") == 0) {
+            commitClock = max<uint64_t>(commitClock, stoull(line.substr(8)));
+            continue;
+        }
+        try {
+            Application app = Application::deserialize(line);
+            if (app.getPetID() == 0) {
+                // Written before applications kept the pet ID; match by name
+                // as the reports used to
+                size_t pet = findPet(app.getPetName());
+                if (pet != pets.size()) app.setPetID(pets[pet].getID());
+            }
+            applications.push_back(app);
+        } catch (const exception& e) {
+            cerr << "Error loading application: " << e.what() << "\n";
+            continue; // Skip invalid entries
+        }
+    }
+    inFile.close();
+    rebuildApplicationIndex();
+    cout << applications.size() << " applications loaded from file.\n";
+}
+
+void PetAdoptionSystem::saveSheltersToFile() {
+    ofstream outFile(dataPath("shelters.dat"));
+    if (!outFile.is_open()) {
+        throw FileOperationException("Failed to open shelters file for writing");
+    }
+    
+    for (const auto& shelter : shelters) {
+        outFile << shelter.serialize() << "\n";
+    }
+    outFile.close();
+    cout << "Shelters saved successfully.\n";
+}
+
+// Deletions are appended as "<table>,<version>,<key>" with table P or A,
+// after a "HORIZON:<version>" header. Once the file has doubled since it was
+// last written whole, the tombstones behind the horizon are pruned and the
+// file is rewritten from the change indexes.
+void PetAdoptionSystem::saveTombstonesToFile() {
+    size_t stored = storedTombstones + pendingTombstones.size();
+    if (!tombstonesOutdated && storedTombstones > 0 &&
+        stored <= max(static_cast<size_t>(MIN_TOMBSTONES_BEFORE_PRUNING), 2 * keptTombstones)) {
+        ofstream outFile(dataPath("tombstones.dat"), ios::app);
+        if (!outFile.is_open()) {
+            throw FileOperationException("Failed to open tombstones file for writing");
+        }
+        
+        for (const auto& tombstone : pendingTombstones) {
+            outFile << tombstone << "\n";
+        }
+        outFile.close();
+        storedTombstones = stored;
+        pendingTombstones.clear();
+        return;
+    }
+    
+    uint64_t horizon = commitClock > DELTA_RETENTION ? commitClock - DELTA_RETENTION : 0;
+    if (!pinnedVersions.empty() && *pinnedVersions.begin() < horizon) horizon = *pinnedVersions.begin();
+    deltaHorizon = max(deltaHorizon, horizon);
+    petChanges.prune(deltaHorizon);
+    applicationChanges.prune(deltaHorizon);
+    
+    string path = dataPath("tombstones.dat");
+    string temp = path + ".tmp";
+    ofstream outFile(temp);
+    if (!outFile.is_open()) {
+        throw FileOperationException("Failed to open tombstones file for writing");
+    }
+    outFile << "HORIZON:" << deltaHorizon << "\n";
+    petChanges.forEachTombstone([&](const string& id, uint64_t version) {
+        outFile << "P," << version << "," << id << "\n";
+    });
+    applicationChanges.forEachTombstone([&](const string& id, uint64_t version) {
+        outFile << "A," << version << "," << id << "\n";
+    });
+    outFile.close();
+    if (!outFile) {
+        remove(temp.c_str());
+        throw FileOperationException("Failed to write tombstones file");
+    }
+    #ifdef _WIN32
+    remove(path.c_str());
+    #endif
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        throw FileOperationException("Failed to replace tombstones file");
+    }
+    storedTombstones = keptTombstones = petChanges.tombstoneCount() + applicationChanges.tombstoneCount();
+    tombstonesOutdated = false;
+    pendingTombstones.clear();
+}
+
+void PetAdoptionSystem::saveSketchesToFile() {
+    ofstream outFile(dataPath("sketches.dat"));
+    if (!outFile.is_open()) {
+        throw FileOperationException("Failed to open sketches file for writing");
+    }
+    
+    // Applications from this ID on are not in the sketches yet
+    outFile << "NEXT_ID:" << nextAppID << "\n";
+    sketches.save(outFile);
+    outFile.close();
+    sketchesDirty = false;
+}
+
+// Sketches saved before the newest applications are caught up from the
+// application table; missing or unreadable sketches are rebuilt from it
+void PetAdoptionSystem::loadSketchesFromFile() {
+    ifstream inFile(dataPath("sketches.dat"));
+    string line;
+    int savedNextID = 1;
+    if (!inFile.is_open() || !getline(inFile, line) || line.compare(0, 8, "NEXT_ID:") != 0 ||
+        !parseText(line.data() + 8, line.data() + line.size(), savedNextID) || !sketches.load(inFile)) {
+        if (inFile.is_open()) cerr << "Error loading sketches: rebuilding them from the applications\n";
+        sketches.clear();
+        savedNextID = 1;
+    }
+    for (const auto& app : applications) {
+        if (app.getID() >= savedNextID) recordInSketches(app);
+    }
+    if (savedNextID != nextAppID) sketchesDirty = true;
+}
+
+// Binary: a header line, the commit, user and pet counts they were saved
+// at, then both filters. The file is a cache that is rebuilt when stale.
+void PetAdoptionSystem::saveFiltersToFile() {
+    ofstream outFile(dataPath("filters.dat"), ios::binary);
+    if (!outFile.is_open()) {
+        throw FileOperationException("Failed to open filters file for writing");
+    }
+    
+    outFile << "BLOOM:1\n";
+    uint64_t header[3] = {commitClock, users.size(), pets.size()};
+    outFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+    userFilter.save(outFile);
+    petFilter.save(outFile);
+    outFile.close();
+    filtersDirty = false;
+}
+
+void PetAdoptionSystem::loadFiltersFromFile() {
+    ifstream inFile(dataPath("filters.dat"), ios::binary);
+    string line;
+    uint64_t header[3];
+    if (inFile.is_open() && getline(inFile, line) && line == "BLOOM:1" &&
+        inFile.read(reinterpret_cast<char*>(header), sizeof(header)) && header[0] == commitClock &&
+        header[1] == users.size() && header[2] == pets.size() &&
+        userFilter.load(inFile) && petFilter.load(inFile)) {
+        filtersDirty = false;
+        return;
+    }
+    rebuildUserFilter();
+    rebuildPetFilter();
+}
+
+// The journal starts with the pets.dat schema its field sets refer to
+void PetAdoptionSystem::savePetEditsToFile() {
+    discardSavedFilters();
+    ofstream outFile(dataPath("pet_edits.dat"), ios::app);
+    if (!outFile.is_open()) {
+        throw FileOperationException("Failed to open pet edits file for writing");
+    }
+    
+    if (journaledPetEdits == 0) outFile << "SCHEMA:" << PETS_SCHEMA << "\n";
+    for (const auto& edit : pendingPetEdits) {
+        outFile << edit << "\n";
+    }
+    outFile.close();
+    journaledPetEdits += pendingPetEdits.size();
+    pendingPetEdits.clear();
+}
+
+// Replay the edits made after pets.dat was written; a save that compacted
+// the journal may have been interrupted, so older records are skipped.
+// Journals from before pets.dat schema 6 name the pet instead of giving its
+// ID and number fields without the ID; pets.dat is rewritten to retire them.
+void PetAdoptionSystem::loadPetEditsFromFile(uint64_t savedVersion) {
+    ifstream inFile(dataPath("pet_edits.dat"));
+    if (!inFile.is_open()) {
+        return; // No edits since the last save
+    }
+    
+    bool legacy = readSchemaHeader(inFile, "pet_edits.dat", PETS_SCHEMA) < 6;
+    unordered_map<string, size_t> positions;
+    for (size_t i = 0; i < pets.size(); ++i) {
+        positions[legacy ? pets[i].getName() : to_string(pets[i].getID())] = i;
+    }
+    if (legacy) dirtyTables |= PETS_TABLE;
+    string line;
+    while (getline(inFile, line)) {
+        journaledPetEdits++;
+        size_t pos1 = line.find(',');
+        size_t pos2 = pos1 == string::npos ? pos1 : line.find(',', pos1 + 1);
+        size_t pos3 = pos2 == string::npos ? pos2 : line.find(',', pos2 + 1);
+        uint64_t version;
+        uint32_t fields;
+        if (pos3 == string::npos || !parseText(line.data(), line.data() + pos1, version) ||
+            !parseText(line.data() + pos2 + 1, line.data() + pos3, fields)) {
+            cerr << "Error loading pet edit: invalid record\n";
+            continue;
+        }
+        if (version <= savedVersion) continue;
+        if (legacy) fields <<= 1;
+        
+        auto found = positions.find(line.substr(pos1 + 1, pos2 - pos1 - 1));
+        if (found == positions.end()) continue; // Skip edits of unknown pets
+        size_t index = found->second;
+        Pet pet = pets[index];
+        if (!TextCodec<Pet>::decode(line.data() + pos3 + 1, line.data() + line.size(), pet, 0, fields)) {
+            cerr << "Error loading pet edit: invalid record\n";
+            continue;
+        }
+        pet.setVersion(version);
+        if (legacy && (fields & fieldBit<Pet::nameField>())) {
+            positions.erase(found);
+            positions[pet.getName()] = index;
+        }
+        pets.mutableAt(index) = pet;
+        commitClock = max(commitClock, version);
+    }
+}
+
+void PetAdoptionSystem::rebuildChangeIndex() {
+    petChanges.clear();
+    applicationChanges.clear();
+    for (const auto& pet : pets) {
+        petChanges.record(to_string(pet.getID()), pet.getVersion(), false);
+        commitClock = max(commitClock, pet.getVersion());
+    }
+    for (const auto& app : applications) {
+        applicationChanges.record(to_string(app.getID()), app.getVersion(), false);
+        commitClock = max(commitClock, app.getVersion());
+    }
+    
+    ifstream inFile(dataPath("tombstones.dat"));
+    if (!inFile.is_open()) {
+        return; // No deletions yet
+    }
+    
+    // Files without a HORIZON header name deleted pets instead of giving
+    // their IDs. Those tombstones are dropped, the horizon moves past them
+    // and the file is rewritten on the next flush.
+    string line;
+    bool legacy = !getline(inFile, line) || line.compare(0, 8, "HORIZON:") != 0;
+    if (legacy) {
+        inFile.clear();
+        inFile.seekg(0, ios::beg);
+        tombstonesOutdated = true;
+    } else {
+        deltaHorizon = stoull(line.substr(8));
+    }
+    while (getline(inFile, line)) {
+        size_t pos1 = line.find(',');
+        size_t pos2 = line.find(',', pos1 + 1);
+        if (pos1 != 1 || pos2 == string::npos) continue; // Skip invalid entries
+        storedTombstones++;
+        
+        ChangeIndex& changes = line[0] == 'P' ? petChanges : applicationChanges;
+        uint64_t version = stoull(line.substr(pos1 + 1, pos2 - pos1 - 1));
+        string key = line.substr(pos2 + 1);
+        if (legacy && line[0] == 'P') {
+            deltaHorizon = max(deltaHorizon, version);
+            commitClock = max(commitClock, version);
+            continue;
+        }
+        // A record added again after its deletion is newer than the tombstone
+        if (version > changes.versionOf(key)) {
+            changes.record(key, version, true);
+        }
+        commitClock = max(commitClock, version);
+    }
+    keptTombstones = petChanges.tombstoneCount() + applicationChanges.tombstoneCount();
+}
+
+void PetAdoptionSystem::loadSheltersFromFile() {
+    ifstream inFile(dataPath("shelters.dat"));
+    if (!inFile.is_open()) {
+        return; // File doesn't exist yet
+    }
+    
+    string line;
+    while (getline(inFile, line)) {
+        try {
+            Shelter shelter = Shelter::deserialize(line);
+            nextShelterID = max(nextShelterID, shelter.getID() + 1);
+            shelters.push_back(shelter);
+        } catch (const exception& e) {
+            cerr << "Error loading shelter: " << e.what() << "\n";
+            continue; // Skip invalid entries
+        }
+    }
+    inFile.close();
+    petLocatorStale = true;
+    cout << shelters.size() << " shelters loaded from file.\n";
+}
+
+void PetAdoptionSystem::rebuildApplicationIndex() {
+    activeApplications.clear();
+    activeApplications.reserve(applications.size());
+    recommender.clear();
+    for (const auto& app : applications) {
+        if (app.getStatus() != "Rejected") {
+            activeApplications.insert(make_pair(app.getUsername(), app.getPetName()));
+        }
+        if (app.getPetID() != 0) recommender.recordApplication(app.getUsername(), app.getPetID(), false);
+    }
+    recommender.rebuildNeighbors();
+}
+
+// Report implementations
+void printAdoptionSummary(const ReportSnapshot& snapshot) {
+    size_t available = 0, adopted = 0;
+    for (const auto& pet : snapshot.pets()) {
+        if (pet.isAdopted()) adopted++;
+        else available++;
+    }
+    
+    map<string, size_t> byStatus;
+    for (const auto& app : snapshot.applications()) {
+        byStatus[app.getStatus()]++;
+    }
+    
+    cout << "\n=== ADOPTION SUMMARY (version " << snapshot.timestamp() << ") ===\n";
+    cout << "Pets: " << snapshot.pets().size() << " (" << available << " available, "
+         << adopted << " adopted)\n";
+    cout << "Applications: " << snapshot.applications().size() << " ("
+         << byStatus["Pending"] << " pending, " << byStatus["Approved"] << " approved, "
+         << byStatus["Rejected"] << " rejected)\n";
+}
+
+// Applications joined with their pet and applicant account, in ID order.
+// Applications whose pet or account has been removed are left out.
+struct ApplicationDetail {
+    const Application* application;
+    const Pet* pet;
+    const User* applicant;
+};
+
+vector<ApplicationDetail> joinApplicationDetails(const ApplicationTable& applications, const PetTable& pets,
+                                                 const vector<unique_ptr<User>>& users) {
+    vector<pair<const Pet*, const Application*>> withPets;
+    withPets.reserve(applications.size());
+    HashJoin::run(pets, [](const Pet& pet) { return pet.getID(); },
+                  applications, [](const Application& app) { return app.getPetID(); },
+                  [&](const Pet& pet, const Application& app) { withPets.push_back(make_pair(&pet, &app)); });
+    
+    vector<ApplicationDetail> details;
+    details.reserve(withPets.size());
+    HashJoin::run(users, [](const unique_ptr<User>& user) -> const string& { return user->getUsername(); },
+                  withPets, [](const pair<const Pet*, const Application*>& row) -> const string& {
+                      return row.second->getUsername();
+                  },
+                  [&](const unique_ptr<User>& user, const pair<const Pet*, const Application*>& row) {
+                      ApplicationDetail detail = { row.second, row.first, user.get() };
+                      details.push_back(detail);
+                  });
+    sort(details.begin(), details.end(), [](const ApplicationDetail& a, const ApplicationDetail& b) {
+        return a.application->getID() < b.application->getID();
+    });
+    return details;
+}
+
+void printApplicationDetails(const ReportSnapshot& snapshot, const vector<unique_ptr<User>>& users) {
+    vector<ApplicationDetail> details = joinApplicationDetails(snapshot.applications(), snapshot.pets(), users);
+    
+    cout << "\n=== APPLICATION DETAILS (version " << snapshot.timestamp() << ") ===\n";
+    if (details.empty()) {
+        cout << "No applications to report.\n";
+    } else {
+        cout << "ID     | Applicant           | Pet           | Breed         | Status\n";
+        cout << "-------+---------------------+---------------+---------------+---------\n";
+        for (const auto& detail : details) {
+            cout << left << setw(7) << detail.application->getID() << "| "
+                 << setw(20) << detail.applicant->getUsername() << "| "
+                 << setw(14) << detail.pet->getName() << "| "
+                 << setw(14) << detail.pet->getBreed() << "| "
+                 << detail.application->getStatus() << "\n";
+        }
+        cout << right;
+    }
+    if (details.size() < snapshot.applications().size()) {
+        cout << snapshot.applications().size() - details.size()
+             << " application(s) refer to a removed pet or account.\n";
+    }
+}
+
+// Every application sorted by applicant and then by ID, as CSV records.
+// Sorts externally within the given memory limit; returns the record count.
+size_t exportApplicationsByUser(const ApplicationTable& applications, const string& tempDir,
+                                size_t memoryLimit, ostream& out) {
+    ExternalSorter sorter(tempDir, memoryLimit);
+    char id[16];
+    string record;
+    for (const auto& app : applications) {
+        // The sort key is followed by the application in the binary layout,
+        // which spills without formatting any numbers
+        snprintf(id, sizeof(id), "%010d", app.getID());
+        record = app.getUsername() + '\0' + id + '\0';
+        BinaryCodec<Application>::encode(app, record);
+        sorter.add(record);
+    }
+    size_t count = 0;
+    Application app(0, "", "");
+    string line;
+    sorter.finish([&](const string& sorted) {
+        const char* pos = sorted.data() + sorted.find('\0', sorted.find('\0') + 1) + 1;
+        if (!BinaryCodec<Application>::decode(pos, sorted.data() + sorted.size(), app)) {
+            throw FileOperationException("Corrupt application sort run");
+        }
+        line.clear();
+        app.serializeTo(line);
+        out << line << "\n";
+        count++;
+    });
+    if (!out) {
+        throw FileOperationException("Failed to write application export");
+    }
+    return count;
 }
 
-void PetAdoptionSystem::saveApplicationsToFile() {
-    ofstream outFile("applications.dat");
-    if (!outFile.is_open()) {
-        throw FileOperationException("Failed to open applications file for writing");
+// Applications, approvals and rejections per applicant, sorted by applicant,
+// as "username,applications,approved,rejected". Aggregates and sorts
+// externally within the given memory limit; returns the applicant count.
+size_t exportApplicantTotals(const ApplicationTable& applications, const string& tempDir,
+                             size_t memoryLimit, ostream& out) {
+    // Half of the budget each for the aggregation and the sort of its results
+    ExternalAggregator totals(tempDir, memoryLimit / 2, 3);
+    ExternalAggregator::Counters counters(3);
+    for (const auto& app : applications) {
+        counters[0] = 1;
+        counters[1] = app.getStatus() == "Approved";
+        counters[2] = app.getStatus() == "Rejected";
+        totals.add(app.getUsername(), counters);
     }
     
-    // Also save the next application ID
-    outFile << "NEXT_ID:" << nextAppID << "\n";
+    ExternalSorter sorter(tempDir, memoryLimit / 2);
+    totals.finish([&](const string& username, const ExternalAggregator::Counters& sums) {
+        // '\0' sorts before any username character, so "anna" precedes "anna b"
+        sorter.add(username + '\0' + to_string(sums[0]) + "," + to_string(sums[1]) + "," + to_string(sums[2]));
+    });
+    size_t count = 0;
+    sorter.finish([&](const string& record) {
+        size_t separator = record.find('\0');
+        out.write(record.data(), separator);
+        out << "," << record.substr(separator + 1) << "\n";
+        count++;
+    });
+    if (!out) {
+        throw FileOperationException("Failed to write applicant totals");
+    }
+    return count;
+}
+
+// Columnar exports: each table is written in row groups of COLUMNAR_ROW_GROUP
+// rows, gathering the column values of a group straight from the records
+const size_t COLUMNAR_ROW_GROUP = 1 << 16;
+
+class RowGroupBuffer {
+public:
+    vector<vector<int64_t>> ints;
+    vector<vector<const string*>> strings;
+    size_t rows = 0;
+    
+    explicit RowGroupBuffer(size_t columns) : ints(columns), strings(columns) {}
     
+    // Write the group once it is full (or when forced) and start the next one
+    void endRow(ColumnarWriter& writer, bool force = false) {
+        if (!force) rows++;
+        if (rows == 0 || (!force && rows < COLUMNAR_ROW_GROUP)) return;
+        writer.writeRowGroup(rows, ints, strings);
+        for (auto& column : ints) column.clear();
+        for (auto& column : strings) column.clear();
+        rows = 0;
+    }
+};
+
+// Birth dates are stored as days since 1970-01-01
+void exportPetsColumnar(const PetTable& pets, const string& path) {
+    vector<ColumnSpec> schema = {
+        {"name", ColumnType::STRING}, {"breed", ColumnType::STRING}, {"birth_date", ColumnType::INT64},
+        {"vaccinated", ColumnType::BOOL}, {"adopted", ColumnType::BOOL}, {"shelter_id", ColumnType::INT64},
+        {"version", ColumnType::INT64}, {"description", ColumnType::STRING}
+    };
+    ColumnarWriter writer(path, schema);
+    RowGroupBuffer group(schema.size());
+    for (const auto& pet : pets) {
+        group.strings[0].push_back(&pet.getName());
+        group.strings[1].push_back(&pet.getBreed());
+        group.ints[2].push_back(pet.getBirthDate().days);
+        group.ints[3].push_back(pet.isVaccinated());
+        group.ints[4].push_back(pet.isAdopted());
+        group.ints[5].push_back(pet.getShelterID());
+        group.ints[6].push_back(static_cast<int64_t>(pet.getVersion()));
+        group.strings[7].push_back(&pet.getDescription());
+        group.endRow(writer);
+    }
+    group.endRow(writer, true);
+    writer.close();
+}
+
+void exportApplicationsColumnar(const ApplicationTable& applications, const string& path) {
+    vector<ColumnSpec> schema = {
+        {"id", ColumnType::INT64}, {"username", ColumnType::STRING}, {"pet_name", ColumnType::STRING},
+        {"status", ColumnType::STRING}, {"version", ColumnType::INT64},
+        {"submitted_at", ColumnType::INT64}, {"decided_at", ColumnType::INT64}
+    };
+    ColumnarWriter writer(path, schema);
+    RowGroupBuffer group(schema.size());
     for (const auto& app : applications) {
-        outFile << app.serialize() << "\n";
+        group.ints[0].push_back(app.getID());
+        group.strings[1].push_back(&app.getUsername());
+        group.strings[2].push_back(&app.getPetName());
+        group.strings[3].push_back(&app.getStatus());
+        group.ints[4].push_back(static_cast<int64_t>(app.getVersion()));
+        group.ints[5].push_back(static_cast<int64_t>(app.getSubmittedAt()));
+        group.ints[6].push_back(static_cast<int64_t>(app.getDecidedAt()));
+        group.endRow(writer);
     }
-    outFile.close();
-    cout << "Applications saved successfully.\n";
+    group.endRow(writer, true);
+    writer.close();
 }
 
-void PetAdoptionSystem::loadApplicationsFromFile() {
-    ifstream inFile("applications.dat");
-    if (!inFile.is_open()) {
-        return; // File doesn't exist yet
+// Print the chosen columns (all when empty) of a columnar file as CSV;
+// string values are quoted
+void printColumnarFile(const string& path, const vector<string>& columnNames, ostream& out) {
+    ColumnarReader reader(path);
+    vector<size_t> projection;
+    for (const auto& name : columnNames) projection.push_back(reader.columnIndex(name));
+    if (projection.empty()) {
+        for (size_t c = 0; c < reader.schema().size(); ++c) projection.push_back(c);
+    }
+    for (size_t i = 0; i < projection.size(); ++i) {
+        out << (i ? "," : "") << reader.schema()[projection[i]].name;
+    }
+    out << "\n";
+    for (size_t group = 0; group < reader.rowGroupCount(); ++group) {
+        vector<ColumnarReader::ColumnValues> values = reader.readRowGroup(group, projection);
+        for (size_t row = 0; row < reader.rowCount(group); ++row) {
+            for (size_t i = 0; i < values.size(); ++i) {
+                if (i) out << ",";
+                if (values[i].type == ColumnType::STRING) writeCsvField(out, values[i].strings[row]);
+                else out << values[i].ints[row];
+            }
+            out << "\n";
+        }
+    }
+}
+
+void printAdoptionAnalytics(const AdoptionAnalytics::Result& result, uint64_t version) {
+    cout << "\n=== ADOPTION ANALYTICS (version " << version << ") ===\n";
+    cout << result.applications << " applications aggregated on " << result.threads
+         << " thread(s) in " << fixed << setprecision(1) << result.elapsedMs << " ms\n";
+    
+    size_t decided = result.approved + result.rejected;
+    cout << "\nDecisions: " << decided << " (" << result.approved << " approved, "
+         << result.rejected << " rejected)\n";
+    if (result.timedDecisions > 0) {
+        cout << "Average time to decision: " << setprecision(1)
+             << result.decisionSeconds / result.timedDecisions / 86400 << " days ("
+             << result.timedDecisions << " dated decisions)\n";
     }
     
-    applications.clear();
-    string line;
+    cout << "\nAdoptions per week:\n";
+    if (result.adoptionsPerWeek.empty()) cout << "  No dated adoptions.\n";
+    for (const auto& week : result.adoptionsPerWeek) {
+        time_t monday = static_cast<time_t>(week.first) * 86400;
+        char label[16];
+        strftime(label, sizeof(label), "%Y-%m-%d", gmtime(&monday));
+        cout << "  Week of " << label << ": " << week.second << "\n";
+    }
     
-    // First line should be the next ID
-    if (getline(inFile, line) && line.substr(0, 8) == "NEXT_ID:") {
-        nextAppID = stoi(line.substr(8));
-    } else {
-        // If not found, reset the file pointer to the beginning
-        inFile.clear();
-        inFile.seekg(0, ios::beg);
+    cout << "\nAdoptions per breed:\n";
+    for (const auto& breed : result.breeds) {
+        cout << "  " << left << setw(16) << breed.first << right << setw(8) << breed.second.second
+             << " adopted, " << breed.second.first << " listed\n";
     }
     
-    // Read all applications
-    while (getline(inFile, line)) {
-        try {
-            Application app = Application::deserialize(line);
-            applications.push_back(app);
-        } catch (const exception& e) {
-            cerr << "Error loading application: " << e.what() << "\n";
-            continue; // Skip invalid entries
+    // Approval ratios: distribution over applicants, then the most active ones
+    size_t buckets[5] = {0, 0, 0, 0, 0};
+    vector<pair<size_t, pair<string, AdoptionAnalytics::Decisions>>> mostActive;
+    for (const auto& shard : result.applicants) {
+        for (const auto& entry : shard) {
+            const AdoptionAnalytics::Decisions& decisions = entry.second;
+            buckets[min<size_t>(4, decisions.approved * 5 / decisions.decided)]++;
+            mostActive.push_back(make_pair(decisions.decided, entry));
+            if (mostActive.size() > 20) {
+                nth_element(mostActive.begin(), mostActive.begin() + 10, mostActive.end(),
+                            [](const pair<size_t, pair<string, AdoptionAnalytics::Decisions>>& a,
+                               const pair<size_t, pair<string, AdoptionAnalytics::Decisions>>& b) {
+                                return a.first > b.first;
+                            });
+                mostActive.resize(10);
+            }
         }
     }
-    inFile.close();
-    cout << applications.size() << " applications loaded from file.\n";
+    sort(mostActive.begin(), mostActive.end(),
+         [](const pair<size_t, pair<string, AdoptionAnalytics::Decisions>>& a,
+            const pair<size_t, pair<string, AdoptionAnalytics::Decisions>>& b) {
+             return a.first != b.first ? a.first > b.first : a.second.first < b.second.first;
+         });
+    if (mostActive.size() > 10) mostActive.resize(10);
+    
+    cout << "\nApproval ratio per applicant (" << result.applicantCount() << " applicants):\n";
+    const char* ranges[5] = {"0-19%", "20-39%", "40-59%", "60-79%", "80-100%"};
+    for (int i = 0; i < 5; ++i) {
+        cout << "  " << left << setw(8) << ranges[i] << right << buckets[i] << " applicants\n";
+    }
+    for (const auto& entry : mostActive) {
+        const AdoptionAnalytics::Decisions& decisions = entry.second.second;
+        cout << "  " << left << setw(20) << entry.second.first << right << decisions.approved << "/"
+             << decisions.decided << " approved (" << setprecision(0)
+             << 100.0 * decisions.approved / decisions.decided << "%)\n";
+    }
+    cout << defaultfloat << setprecision(6);
+}
+
+// Analytics over generated in-memory tables, so large runs need no data
+// directory: applications are spread over the applicants and pets, a fifth
+// are approved and two fifths rejected, over the past two years.
+int runAnalyticsBenchmark(size_t applicationCount, size_t applicantCount, size_t petCount, unsigned threads) {
+    if (applicantCount == 0 || petCount == 0) {
+        throw InvalidInputException("The benchmark needs at least one applicant and one pet");
+    }
+    const char* breeds[] = {"Labrador", "Siamese", "Beagle", "Persian", "Poodle"};
+    PetTable pets;
+    for (size_t i = 0; i < petCount; ++i) {
+        Pet pet("Bench" + to_string(i), breeds[i % 5], Date(), false);
+        pet.setID(static_cast<int>(i + 1));
+        pets.push_back(pet);
+    }
+    ApplicationTable applications;
+    time_t now = time(nullptr);
+    for (size_t i = 0; i < applicationCount; ++i) {
+        // Mix the index so applicants, pets and outcomes are uncorrelated
+        uint64_t mix = i + 1;
+        mix = (mix ^ (mix >> 33)) * 0xff51afd7ed558ccdULL;
+        mix = (mix ^ (mix >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+        mix ^= mix >> 33;
+        size_t pet = (mix >> 20) % petCount;
+        Application app(static_cast<int>(i + 1), "applicant" + to_string(mix % applicantCount),
+                        "Bench" + to_string(pet), static_cast<int>(pet + 1));
+        time_t submitted = now - static_cast<time_t>((mix >> 8) % 730) * 86400;
+        time_t decided = submitted + static_cast<time_t>((mix >> 48) % 30) * 86400;
+        app.setSubmittedAt(submitted);
+        if ((mix >> 40) % 5 == 0) {
+            app.approve(decided);
+        } else if ((mix >> 40) % 5 < 3) {
+            app.reject(decided);
+        }
+        applications.push_back(app);
+    }
+    cout << "Generated " << applicationCount << " applications from " << applicantCount << " applicants for "
+         << petCount << " pets\n";
+    printAdoptionAnalytics(AdoptionAnalytics::compute(pets, applications, threads), 0);
+    cout << defaultfloat << setprecision(6);
+    return 0;
+}
+
+// Approximate popularity from the application sketches; counts carry the
+// Space-Saving error bound and distinct applicants are HyperLogLog estimates
+void printPopularity(const ApplicationSketches& sketches, size_t k) {
+    cout << "\n=== POPULARITY (approximate) ===\n";
+    cout << "\nMost requested breeds (" << sketches.breedApplications() << " applications):\n";
+    vector<SpaceSaving::Counter> breeds = sketches.topBreeds(k);
+    if (breeds.empty()) cout << "  No applications yet.\n";
+    for (const auto& breed : breeds) {
+        cout << "  " << left << setw(16) << breed.key << right << setw(8) << breed.count << " applications";
+        if (breed.error > 0) cout << " (at most " << breed.error << " over)";
+        cout << ", ~" << llround(sketches.distinctBreedApplicants(breed.key)) << " distinct applicants\n";
+    }
+    
+    cout << "\nPets with the most distinct applicants:\n";
+    vector<pair<string, double>> pets = sketches.topPets(k);
+    if (pets.empty()) cout << "  No applications yet.\n";
+    for (const auto& pet : pets) {
+        cout << "  " << left << setw(16) << pet.first << right << " ~" << llround(pet.second) << "\n";
+    }
 }
 
 // Admin actions implementation
@@ -756,7 +7476,7 @@ void Admin::performAction(PetAdoptionSystem& system) {
         showDashboard();
         
         try {
-            choice = system.getNumericInput("Enter choice: ", 1, 6);
+            choice = system.getNumericInput("Enter choice: ", 1, 9);
             
             switch (choice) {
                 case 1: { // Add Admin
@@ -766,10 +7486,8 @@ void Admin::performAction(PetAdoptionSystem& system) {
                         "Admin username (4-20 chars, case-sensitive): ", 
                         isValidUsername, "Invalid username format");
                     
-                    for (const auto& user : system.getAllUsers()) {
-                        if (user->getUsername() == username) {
-                            throw InvalidInputException("Username already exists");
-                        }
+                    if (system.hasUser(username)) {
+                        throw InvalidInputException("Username already exists");
                     }
                     
                     string password = system.getHiddenInput("Password: ");
@@ -794,7 +7512,8 @@ void Admin::performAction(PetAdoptionSystem& system) {
                     
                     for (size_t i = 0; i < allUsers.size(); ++i) {
                         cout << i+1 << ". " << allUsers[i]->getUsername() 
-                             << " (" << (allUsers[i]->getRole() == Role::ADMIN ? "Admin" : "User") << ")\n";
+                             << " (" << (allUsers[i]->getRole() == Role::ADMIN ? "Admin" : "User") << ")"
+                             << (allUsers[i]->hasPassword() ? "" : " - no password set") << "\n";
                     }
                     
                     int idx = system.getNumericInput("Select user (0 to cancel): ", 0, allUsers.size()) - 1;
@@ -808,14 +7527,23 @@ void Admin::performAction(PetAdoptionSystem& system) {
                         case 1: {
                             string newName = system.getValidatedInput(
                                 "New username: ", isValidUsername, "Invalid username");
-                            system.updateUser(idx, newName, allUsers[idx]->getPassword());
+                            if (!system.updateUser(idx, newName, allUsers[idx]->getPassword())) {
+                                cout << "No changes made.\n";
+                                break;
+                            }
                             // The updateUser method already calls saveUsersToFile() internally
                             cout << "Username updated and saved!\n";
                             break;
                         }
                         case 2: {
                             string newPwd = system.getHiddenInput("New password: ");
-                            system.updateUser(idx, allUsers[idx]->getUsername(), newPwd);
+                            if (!isValidPassword(newPwd)) {
+                                throw InvalidInputException("Invalid password");
+                            }
+                            if (!system.updateUser(idx, allUsers[idx]->getUsername(), newPwd)) {
+                                cout << "No changes made.\n";
+                                break;
+                            }
                             // The updateUser method already calls saveUsersToFile() internally
                             cout << "Password updated and saved!\n";
                             break;
@@ -832,8 +7560,9 @@ void Admin::performAction(PetAdoptionSystem& system) {
                 case 3: { // Manage Pets
                     system.clearScreen();
                     cout << "\n=== MANAGE PETS ===\n";
-                    cout << "1. Add Pet\n2. Edit Pet\n3. Delete Pet\n4. View All Pets\n0. Back\n";
-                    int petChoice = system.getNumericInput("Enter choice: ", 0, 4);
+                    cout << "1. Add Pet\n2. Edit Pet\n3. Delete Pet\n4. View All Pets\n5. Manage Shelters\n6. Pet Photos\n"
+                         << "7. Bulk Import from CSV\n0. Back\n";
+                    int petChoice = system.getNumericInput("Enter choice: ", 0, 7);
                     
                     if (petChoice == 0) break;
                     
@@ -845,13 +7574,33 @@ void Admin::performAction(PetAdoptionSystem& system) {
                             cout << "\n=== ADD NEW PET ===\n";
                             string name = system.getValidatedInput(
                                 "Pet name: ", isValidName, "Invalid name");
+                            if (system.hasPet(name)) {
+                                cout << "A pet named " << name << " already exists.\n";
+                                break;
+                            }
                             string breed = system.getValidatedInput(
                                 "Breed: ", isValidBreed, "Invalid breed");
-                            int age = system.getAgeInput("Age: ");
+                            Date birthDate = system.getAgeInput("Age or birth date: ");
                             bool vaccinated = system.getNumericInput(
                                 "Vaccinated? (1=Yes, 0=No): ", 0, 1);
                             
-                            system.addPet(name, breed, age, vaccinated);
+                            int shelterID = 0;
+                            const auto& allShelters = system.getAllShelters();
+                            if (!allShelters.empty()) {
+                                for (size_t i = 0; i < allShelters.size(); ++i) {
+                                    cout << i+1 << ". " << allShelters[i].getName() << "\n";
+                                }
+                                int shelterIdx = system.getNumericInput(
+                                    "Shelter (0 for none): ", 0, allShelters.size()) - 1;
+                                if (shelterIdx != -1) shelterID = allShelters[shelterIdx].getID();
+                            }
+                            
+                            string description = system.getValidatedInput(
+                                "Description, e.g. 'good with kids' (0 to skip): ",
+                                isValidDescription, "Invalid description");
+                            if (description == "0") description = "";
+                            
+                            system.addPet(name, breed, birthDate, vaccinated, shelterID, description);
                             cout << "Pet added successfully!\n";
                             break;
                         }
@@ -873,38 +7622,53 @@ void Admin::performAction(PetAdoptionSystem& system) {
                             const Pet& pet = allPets[petIdx];
                             cout << "1. Name: " << pet.getName() << "\n";
                             cout << "2. Breed: " << pet.getBreed() << "\n";
-                            cout << "3. Age: " << pet.getAge() << "\n";
+                            cout << "3. Age: " << pet.getAge() << " (born " << pet.getBirthDate().toString() << ")\n";
                             cout << "4. Vaccinated: " << (pet.isVaccinated() ? "Yes" : "No") << "\n";
+                            cout << "5. Description: " << pet.getDescription() << "\n";
                             cout << "0. Back\n";
                             
-                            int field = system.getNumericInput("Select field to edit: ", 0, 4);
+                            int field = system.getNumericInput("Select field to edit: ", 0, 5);
                             if (field == 0) break;
                             
                             string newName = pet.getName();
                             string newBreed = pet.getBreed();
-                            int newAge = pet.getAge();
+                            Date newBirthDate = pet.getBirthDate();
                             bool newVax = pet.isVaccinated();
+                            string newDescription = pet.getDescription();
                             
                             switch (field) {
                                 case 1:
                                     newName = system.getValidatedInput(
                                         "New name: ", isValidName, "Invalid name");
+                                    if (newName != pet.getName() && system.hasPet(newName)) {
+                                        cout << "A pet named " << newName << " already exists.\n";
+                                        newName = pet.getName();
+                                    }
                                     break;
                                 case 2:
                                     newBreed = system.getValidatedInput(
                                         "New breed: ", isValidBreed, "Invalid breed");
                                     break;
                                 case 3:
-                                    newAge = system.getAgeInput("New age: ");
+                                    newBirthDate = system.getAgeInput("New age or birth date: ");
                                     break;
                                 case 4:
                                     newVax = system.getNumericInput(
                                         "Vaccinated? (1=Yes, 0=No): ", 0, 1);
                                     break;
+                                case 5:
+                                    newDescription = system.getValidatedInput(
+                                        "New description (0 to clear): ",
+                                        isValidDescription, "Invalid description");
+                                    if (newDescription == "0") newDescription = "";
+                                    break;
                             }
                             
-                            system.editPet(petIdx, newName, newBreed, newAge, newVax);
-                            cout << "Pet updated successfully!\n";
+                            if (system.editPet(petIdx, newName, newBreed, newBirthDate, newVax, newDescription)) {
+                                cout << "Pet updated successfully!\n";
+                            } else {
+                                cout << "No changes made.\n";
+                            }
                             break;
                         }
                         case 3: { // Delete Pet
@@ -927,8 +7691,51 @@ void Admin::performAction(PetAdoptionSystem& system) {
                             break;
                         }
                         case 4: { // View All Pets
+                            system.viewAllPets(true);
+                            break;
+                        }
+                        case 5: { // Manage Shelters
                             system.clearScreen();
-                            cout << "\n=== ALL PETS ===\n";
+                            cout << "\n=== MANAGE SHELTERS ===\n";
+                            const auto& allShelters = system.getAllShelters();
+                            for (size_t i = 0; i < allShelters.size(); ++i) {
+                                cout << i+1 << ". " << allShelters[i].getName()
+                                     << " (" << allShelters[i].getLatitude() << ", "
+                                     << allShelters[i].getLongitude() << ")\n";
+                            }
+                            if (allShelters.empty()) cout << "No shelters registered.\n";
+                            
+                            cout << "\n1. Add Shelter\n2. Assign Pet to Shelter\n0. Back\n";
+                            int shelterChoice = system.getNumericInput("Enter choice: ", 0, 2);
+                            if (shelterChoice == 1) {
+                                string shelterName = system.getValidatedInput(
+                                    "Shelter name: ", isValidName, "Invalid name");
+                                if (shelterName == "0") break;
+                                double lat = system.getDecimalInput("Latitude: ", -90, 90);
+                                double lon = system.getDecimalInput("Longitude: ", -180, 180);
+                                system.addShelter(shelterName, lat, lon);
+                                cout << "Shelter added successfully!\n";
+                            } else if (shelterChoice == 2) {
+                                if (allShelters.empty() || allPets.empty()) {
+                                    cout << "Both a shelter and a pet are needed.\n";
+                                    break;
+                                }
+                                for (size_t i = 0; i < allPets.size(); ++i) {
+                                    cout << i+1 << ". " << allPets[i].getName() 
+                                         << " (" << system.getShelterName(allPets[i].getShelterID()) << ")\n";
+                                }
+                                int petIdx = system.getNumericInput(
+                                    "Select pet (0 to cancel): ", 0, allPets.size()) - 1;
+                                if (petIdx == -1) break;
+                                int shelterIdx = system.getNumericInput(
+                                    "Select shelter number (0 to unassign): ", 0, allShelters.size()) - 1;
+                                system.assignPetToShelter(petIdx,
+                                    shelterIdx == -1 ? 0 : allShelters[shelterIdx].getID());
+                                cout << "Pet shelter updated!\n";
+                            }
+                            break;
+                        }
+                        case 6: { // Pet Photos
                             if (allPets.empty()) {
                                 cout << "No pets in the system.\n";
                                 break;
@@ -936,11 +7743,51 @@ void Admin::performAction(PetAdoptionSystem& system) {
                             
                             for (size_t i = 0; i < allPets.size(); ++i) {
                                 cout << i+1 << ". " << allPets[i].getName() 
-                                     << " (" << allPets[i].getBreed() 
-                                     << "), Age: " << allPets[i].getAge() 
-                                     << ", Vaccinated: " << (allPets[i].isVaccinated() ? "Yes" : "No")
-                                     << ", Status: " << (allPets[i].isAdopted() ? "Adopted" : "Available") << "\n";
+                                     << " (" << system.getPetPhotos(i).size() << " photos)\n";
+                            }
+                            int petIdx = system.getNumericInput(
+                                "Select pet (0 to cancel): ", 0, allPets.size()) - 1;
+                            if (petIdx == -1) break;
+                            
+                            cout << "1. Attach Photo\n2. Export Photo\n0. Back\n";
+                            int photoChoice = system.getNumericInput("Enter choice: ", 0, 2);
+                            if (photoChoice == 1) {
+                                cout << "Image file path: ";
+                                string path;
+                                getline(cin >> ws, path);
+                                string hash = system.addPetPhoto(petIdx, path);
+                                cout << "Photo stored as " << hash << "\n";
+                            } else if (photoChoice == 2) {
+                                vector<string> photos = system.getPetPhotos(petIdx);
+                                if (photos.empty()) {
+                                    cout << "This pet has no photos.\n";
+                                    break;
+                                }
+                                for (size_t i = 0; i < photos.size(); ++i) {
+                                    cout << i+1 << ". " << photos[i] << "\n";
+                                }
+                                int photoIdx = system.getNumericInput(
+                                    "Select photo (0 to cancel): ", 0, photos.size()) - 1;
+                                if (photoIdx == -1) break;
+                                cout << "Destination file path: ";
+                                string path;
+                                getline(cin >> ws, path);
+                                system.getPhotoStore().exportPhoto(photos[photoIdx], path);
+                                cout << "Photo exported to " << path << "\n";
+                            }
+                            break;
+                        }
+                        case 7: { // Bulk Import from CSV
+                            cout << "Columns: name,breed,age or birth_date[,vaccinated][,shelter_id][,description]\n";
+                            cout << "CSV file path: ";
+                            string path;
+                            getline(cin >> ws, path);
+                            ifstream in(path, ios::binary);
+                            if (!in.is_open()) {
+                                throw FileOperationException("Failed to open " + path);
                             }
+                            ImportResult result = PetCsvImporter(system).run(in);
+                            result.print("pets");
                             break;
                         }
                     }
@@ -991,8 +7838,9 @@ void Admin::performAction(PetAdoptionSystem& system) {
                 case 5: { // Search Pets
                     system.clearScreen();
                     cout << "\n=== SEARCH PETS ===\n";
-                    cout << "1. By Name\n2. By Breed\n3. By Age Range\n4. View All Pets\n0. Back\n";
-                    int searchChoice = system.getNumericInput("Enter choice: ", 0, 4);
+                    cout << "1. By Name\n2. By Breed\n3. By Age Range\n4. View All Pets\n5. By Description\n"
+                         << "6. By Query\n0. Back\n";
+                    int searchChoice = system.getNumericInput("Enter choice: ", 0, 6);
                     
                     if (searchChoice == 0) break;
                     
@@ -1001,6 +7849,30 @@ void Admin::performAction(PetAdoptionSystem& system) {
                         break;
                     }
                     
+                    vector<Pet> results;
+                    if (searchChoice == 5) {
+                        string query = system.getValidatedInput(
+                            "Enter words to search for: ", isValidDescription, "Invalid search");
+                        for (const auto& hit : system.searchDescriptions(query, 20, false)) {
+                            results.push_back(system.getAllPets()[hit.second]);
+                        }
+                    } else if (searchChoice == 6) {
+                        cout << "Fields: name, breed, description, age, born, shelter, vaccinated, adopted\n"
+                             << "Example: breed ~ \"lab\" and age <= 3 and vaccinated and not adopted\n"
+                             << "Query: ";
+                        string text;
+                        getline(cin, text);
+                        try {
+                            PetQuery query = PetQuery::compile(text);
+                            for (size_t position : system.queryPets(query)) {
+                                results.push_back(system.getAllPets()[position]);
+                            }
+                        } catch (const InvalidInputException& e) {
+                            cout << "Invalid query: " << e.what() << "\n";
+                            break;
+                        }
+                    }
+                    
                     unique_ptr<SearchStrategy> strategy;
                     switch (searchChoice) {
                         case 1: {
@@ -1016,14 +7888,21 @@ void Admin::performAction(PetAdoptionSystem& system) {
                             break;
                         }
                         case 3: {
+                            // Served from the age order, youngest first
                             int minAge = system.getNumericInput("Enter minimum age: ", 0, 30);
                             int maxAge = system.getNumericInput("Enter maximum age: ", minAge, 30);
-                            strategy.reset(new AgeRangeSearchStrategy(minAge, maxAge));
+                            pair<size_t, size_t> ranks = system.getAgeRankRange(minAge, maxAge);
+                            for (size_t position : system.getPetPage(PETS_BY_AGE, ranks.first,
+                                                                     ranks.second - ranks.first)) {
+                                results.push_back(system.getAllPets()[position]);
+                            }
                             break;
                         }
                     }
                     
-                    vector<Pet> results = system.searchPets(move(strategy));
+                    if (strategy) {
+                        results = system.searchPets(move(strategy));
+                    }
                     if (results.empty()) {
                         cout << "No matching pets found.\n";
                     } else {
@@ -1038,7 +7917,109 @@ void Admin::performAction(PetAdoptionSystem& system) {
                     }
                     break;
                 }
-                case 6: // Logout
+                case 6: { // Undo / Redo
+                    system.clearScreen();
+                    cout << "\n=== UNDO / REDO ===\n";
+                    string nextUndo = system.peekUndo();
+                    string nextRedo = system.peekRedo();
+                    cout << "1. Undo" << (nextUndo.empty() ? " (nothing to undo)" : ": " + nextUndo) << "\n";
+                    cout << "2. Redo" << (nextRedo.empty() ? " (nothing to redo)" : ": " + nextRedo) << "\n";
+                    cout << "0. Back\n";
+                    int undoChoice = system.getNumericInput("Enter choice: ", 0, 2);
+                    if (undoChoice == 1) {
+                        string action = system.undo();
+                        cout << (action.empty() ? "Nothing to undo.\n" : "Undone: " + action + "\n");
+                    } else if (undoChoice == 2) {
+                        string action = system.redo();
+                        cout << (action.empty() ? "Nothing to redo.\n" : "Redone: " + action + "\n");
+                    }
+                    break;
+                }
+                case 7: { // Reports
+                    system.clearScreen();
+                    cout << "\n=== REPORTS ===\n";
+                    cout << "1. Adoption Summary\n2. Adoption Analytics\n3. Application Details\n"
+                         << "4. Applicant Totals\n5. Popularity\n0. Back\n";
+                    int reportChoice = system.getNumericInput("Enter choice: ", 0, 5);
+                    if (reportChoice == 1) {
+                        ReportSnapshot snapshot(system);
+                        printAdoptionSummary(snapshot);
+                    } else if (reportChoice == 2) {
+                        ReportSnapshot snapshot(system);
+                        printAdoptionAnalytics(
+                            AdoptionAnalytics::compute(snapshot.pets(), snapshot.applications()),
+                            snapshot.timestamp());
+                    } else if (reportChoice == 3) {
+                        ReportSnapshot snapshot(system);
+                        printApplicationDetails(snapshot, system.getAllUsers());
+                    } else if (reportChoice == 4) {
+                        ReportSnapshot snapshot(system);
+                        cout << "\n=== APPLICANT TOTALS (version " << snapshot.timestamp() << ") ===\n";
+                        cout << "username,applications,approved,rejected\n";
+                        exportApplicantTotals(snapshot.applications(), system.getTempDirectory(),
+                                              system.getReportMemoryLimit(), cout);
+                    } else if (reportChoice == 5) {
+                        printPopularity(system.getApplicationSketches(), 10);
+                    }
+                    break;
+                }
+                case 8: { // Data Tools
+                    system.clearScreen();
+                    cout << "\n=== DATA TOOLS ===\n";
+                    cout << "Current data version: " << system.getCommitTimestamp() << "\n";
+                    if (!system.getMigrationStatus().empty()) {
+                        cout << "Schema migration: " << system.getMigrationStatus() << "\n";
+                    }
+                    cout << "1. Start Online Backup\n2. Backup Status\n"
+                         << "3. Export Changes Since Version\n4. Export Columnar Files\n"
+                         << "5. Import JSON Lines\n6. Export JSON Lines\n0. Back\n";
+                    int toolChoice = system.getNumericInput("Enter choice: ", 0, 6);
+                    if (toolChoice == 1) {
+                        cout << "Backup directory: ";
+                        string target;
+                        getline(cin >> ws, target);
+                        int rate = system.getNumericInput(
+                            "Rate limit in KB/s (0 for unlimited): ", 0, 1000000);
+                        system.startBackup(target, static_cast<uint64_t>(rate) * 1024);
+                        cout << "Backup started in the background. You can keep working.\n";
+                    } else if (toolChoice == 2) {
+                        cout << system.getBackupStatus() << "\n";
+                    } else if (toolChoice == 3) {
+                        int since = system.getNumericInput("Export changes after version: ", 0,
+                            static_cast<int>(min<uint64_t>(system.getCommitTimestamp(),
+                                                           numeric_limits<int>::max())));
+                        cout << "Output file: ";
+                        string target;
+                        getline(cin >> ws, target);
+                        ofstream out(target);
+                        if (!out.is_open()) {
+                            throw FileOperationException("Failed to open " + target);
+                        }
+                        size_t count = system.exportChanges(since, out);
+                        cout << count << " changed record(s) exported up to version "
+                             << system.getCommitTimestamp() << ".\n";
+                    } else if (toolChoice == 4) {
+                        cout << "Export directory: ";
+                        string target;
+                        getline(cin >> ws, target);
+                        makeDirectory(target);
+                        ReportSnapshot snapshot(system);
+                        exportPetsColumnar(snapshot.pets(), target + "/pets.pcol");
+                        exportApplicationsColumnar(snapshot.applications(), target + "/applications.pcol");
+                        cout << "Version " << snapshot.timestamp() << " exported to " << target
+                             << "/pets.pcol and applications.pcol.\n";
+                    } else if (toolChoice == 5 || toolChoice == 6) {
+                        cout << "1. Pets\n2. Applications\n3. Users\n";
+                        int table = system.getNumericInput("Table: ", 1, 3);
+                        cout << (toolChoice == 5 ? "Input file: " : "Output file: ");
+                        string path;
+                        getline(cin >> ws, path);
+                        const char* tables[] = {"pets", "applications", "users"};
+                        runJsonLinesTransfer(system, toolChoice == 5, tables[table - 1], path);
+                    }
+                    break;
+                }
+                case 9: // Logout
                     cout << "Logging out...\n";
                     break;
             }
@@ -1048,14 +8029,17 @@ void Admin::performAction(PetAdoptionSystem& system) {
             cout << "An error occurred: " << e.what() << "\n";
         }
         
-if (choice != 6) {
+if (choice != 9) {
     string input;
     do {
         cout << "\nInput Y to continue: ";
         getline(cin, input);
     } while (!validateYesNo(input));
 }
-    } while (choice != 6);
+    } while (choice != 9);
+    
+    // Changes made in this session can no longer be undone
+    system.clearUndoHistory();
 }
 
 // RegularUser actions implementation
@@ -1066,7 +8050,7 @@ void RegularUser::performAction(PetAdoptionSystem& system) {
         showDashboard();
         
         try {
-            choice = system.getNumericInput("Enter choice: ", 1, 4);
+            choice = system.getNumericInput("Enter choice: ", 1, 8);
             
             switch (choice) {
                 case 1: { // Browse Pets
@@ -1086,6 +8070,9 @@ void RegularUser::performAction(PetAdoptionSystem& system) {
                                  << " (" << allPets[i].getBreed() 
                                  << "), Age: " << allPets[i].getAge() 
                                  << ", Vaccinated: " << (allPets[i].isVaccinated() ? "Yes" : "No") << "\n";
+                            if (!allPets[i].getDescription().empty()) {
+                                cout << "   " << allPets[i].getDescription() << "\n";
+                            }
                             availableIndices.push_back(i);
                         }
                     }
@@ -1139,7 +8126,166 @@ void RegularUser::performAction(PetAdoptionSystem& system) {
                     }
                     break;
                 }
-                case 4: // Logout
+                case 4: { // Recommendations
+                    system.clearScreen();
+                    cout << "\n=== RECOMMENDED FOR YOU ===\n";
+                    
+                    vector<size_t> recommended = system.recommendPets(username, 5);
+                    if (recommended.empty()) {
+                        cout << "No recommendations yet. Apply for a pet to get suggestions.\n";
+                        break;
+                    }
+                    
+                    const auto& allPets = system.getAllPets();
+                    for (size_t i = 0; i < recommended.size(); ++i) {
+                        const Pet& pet = allPets[recommended[i]];
+                        cout << i+1 << ". " << pet.getName() 
+                             << " (" << pet.getBreed() 
+                             << "), Age: " << pet.getAge() 
+                             << ", Vaccinated: " << (pet.isVaccinated() ? "Yes" : "No") << "\n";
+                    }
+                    
+                    cout << "\n0. Back\n";
+                    int petChoice = system.getNumericInput(
+                        "Select pet to apply for adoption (0 to cancel): ", 0, recommended.size());
+                    if (petChoice == 0) break;
+                    
+                    const string petName = allPets[recommended[petChoice-1]].getName();
+                    system.createApplication(username, petName);
+                    cout << "Application submitted for " << petName << "!\n";
+                    break;
+                }
+                case 5: { // Similar Pets
+                    system.clearScreen();
+                    cout << "\n=== FIND SIMILAR PETS ===\n";
+                    
+                    const auto& allPets = system.getAllPets();
+                    if (allPets.empty()) {
+                        cout << "No pets in the system.\n";
+                        break;
+                    }
+                    
+                    for (size_t i = 0; i < allPets.size(); ++i) {
+                        cout << i+1 << ". " << allPets[i].getName() 
+                             << " (" << allPets[i].getBreed() << ")"
+                             << (allPets[i].isAdopted() ? " - Adopted" : "") << "\n";
+                    }
+                    
+                    int refIdx = system.getNumericInput(
+                        "Find pets similar to (0 to cancel): ", 0, allPets.size()) - 1;
+                    if (refIdx == -1) break;
+                    
+                    vector<size_t> similar = system.findSimilarPets(refIdx, 5);
+                    if (similar.empty()) {
+                        cout << "No similar pets available.\n";
+                        break;
+                    }
+                    
+                    cout << "\n=== PETS LIKE " << allPets[refIdx].getName() << " ===\n";
+                    for (size_t i = 0; i < similar.size(); ++i) {
+                        const Pet& pet = allPets[similar[i]];
+                        cout << i+1 << ". " << pet.getName() 
+                             << " (" << pet.getBreed() 
+                             << "), Age: " << pet.getAge() 
+                             << ", Vaccinated: " << (pet.isVaccinated() ? "Yes" : "No") << "\n";
+                    }
+                    
+                    cout << "\n0. Back\n";
+                    int petChoice = system.getNumericInput(
+                        "Select pet to apply for adoption (0 to cancel): ", 0, similar.size());
+                    if (petChoice == 0) break;
+                    
+                    const string petName = allPets[similar[petChoice-1]].getName();
+                    system.createApplication(username, petName);
+                    cout << "Application submitted for " << petName << "!\n";
+                    break;
+                }
+                case 6: { // Pets Near You
+                    system.clearScreen();
+                    cout << "\n=== FIND PETS NEAR YOU ===\n";
+                    
+                    double lat = system.getDecimalInput("Your latitude: ", -90, 90);
+                    double lon = system.getDecimalInput("Your longitude: ", -180, 180);
+                    
+                    PetFilter filter;
+                    string breed = system.getValidatedInput(
+                        "Breed (0 for any): ", isValidBreed, "Invalid breed");
+                    if (breed != "0") filter.breed = breed;
+                    filter.minAge = system.getNumericInput("Minimum age: ", 0, 30);
+                    filter.maxAge = system.getNumericInput("Maximum age: ", filter.minAge, 30);
+                    filter.vaccinatedOnly = system.getNumericInput(
+                        "Vaccinated only? (1=Yes, 0=No): ", 0, 1);
+                    
+                    cout << "1. Within a distance\n2. Nearest pets\n";
+                    int mode = system.getNumericInput("Enter choice: ", 1, 2);
+                    vector<pair<double, size_t>> found;
+                    if (mode == 1) {
+                        double radius = system.getDecimalInput("Distance in km: ", 0, 20000);
+                        found = system.findPetsWithin(lat, lon, radius, filter);
+                    } else {
+                        size_t k = system.getNumericInput("How many pets: ", 1, 50);
+                        found = system.findNearestPets(lat, lon, k, filter);
+                    }
+                    
+                    if (found.empty()) {
+                        cout << "No matching pets found nearby.\n";
+                        break;
+                    }
+                    
+                    const auto& allPets = system.getAllPets();
+                    for (size_t i = 0; i < found.size(); ++i) {
+                        const Pet& pet = allPets[found[i].second];
+                        cout << i+1 << ". " << pet.getName() 
+                             << " (" << pet.getBreed() 
+                             << "), Age: " << pet.getAge() 
+                             << ", " << system.getShelterName(pet.getShelterID())
+                             << ", " << fixed << setprecision(1) << found[i].first << " km\n";
+                    }
+                    cout << defaultfloat << setprecision(6);
+                    
+                    cout << "\n0. Back\n";
+                    int petChoice = system.getNumericInput(
+                        "Select pet to apply for adoption (0 to cancel): ", 0, found.size());
+                    if (petChoice == 0) break;
+                    
+                    const string petName = allPets[found[petChoice-1].second].getName();
+                    system.createApplication(username, petName);
+                    cout << "Application submitted for " << petName << "!\n";
+                    break;
+                }
+                case 7: { // Description Search
+                    system.clearScreen();
+                    cout << "\n=== SEARCH DESCRIPTIONS ===\n";
+                    
+                    string query = system.getValidatedInput(
+                        "What are you looking for? (e.g. 'good with kids'): ",
+                        isValidDescription, "Invalid search");
+                    vector<pair<float, size_t>> hits = system.searchDescriptions(query, 10, true);
+                    if (hits.empty()) {
+                        cout << "No matching pets found.\n";
+                        break;
+                    }
+                    
+                    const auto& allPets = system.getAllPets();
+                    for (size_t i = 0; i < hits.size(); ++i) {
+                        const Pet& pet = allPets[hits[i].second];
+                        cout << i+1 << ". " << pet.getName() 
+                             << " (" << pet.getBreed() 
+                             << "), Age: " << pet.getAge() << "\n"
+                             << "   " << pet.getDescription() << "\n";
+                    }
+                    
+                    cout << "\n0. Back\n";
+                    int petChoice = system.getNumericInput(
+                        "Select pet to apply for adoption (0 to cancel): ", 0, hits.size());
+                    if (petChoice == 0) break;
+                    
+                    const string petName = allPets[hits[petChoice-1].second].getName();
+                    system.createApplication(username, petName);
+                    cout << "Application submitted for " << petName << "!\n";
+                    break;
+                }
+                case 8: // Logout
                     cout << "Logging out...\n";
                     break;
             }
@@ -1147,14 +8293,14 @@ void RegularUser::performAction(PetAdoptionSystem& system) {
             cout << "An error occurred: " << e.what() << "\n";
         }
         
-      if (choice != 4) {
+      if (choice != 8) {
     string input;
     do {
         cout << "\nInput Y to continue: ";
         getline(cin, input);
     } while (!validateYesNo(input));
 }
-    } while (choice != 4);
+    } while (choice != 8);
 }
 
 // Main system operations
@@ -1241,10 +8387,8 @@ void PetAdoptionSystem::registerUser(Role role) {
         
         if (username == "0") return;
         
-        for (const auto& user : users) {
-            if (user->getUsername() == username) {
-                throw InvalidInputException("Username already exists");
-            }
+        if (hasUser(username)) {
+            throw InvalidInputException("Username already exists");
         }
         
         string password = getHiddenInput("Enter password: ");
@@ -1299,7 +8443,8 @@ User* PetAdoptionSystem::login(Role role) {
             
             // Create default admin if not found
             users.push_back(unique_ptr<User>(new Admin("admin", "admin123")));
-            saveUsersToFile();
+            rememberUsername("admin");
+            markDirty(USERS_TABLE);
             cout << "Login credentials saved successfully.\n";
             cout << "\nDefault admin created and login successful!\n";
             return users.back().get();
@@ -1325,10 +8470,271 @@ User* PetAdoptionSystem::login(Role role) {
     }
 }
 
-int main() {
+// Batch commands run against one shelter without the interactive menus
+bool isBatchCommand(const string& name) {
+    return name == "backup" || name == "export-delta" || name == "analytics" ||
+           name == "export-by-user" || name == "applicant-totals" ||
+           name == "export-columnar" || name == "read-columnar" ||
+           name == "import-jsonl" || name == "export-jsonl" || name == "import-csv" ||
+           name == "migrate" || name == "popularity" || name == "list-pets" || name == "query" ||
+           name == "bench-jsonl" || name == "bench-analytics";
+}
+
+int runBatchCommand(PetAdoptionSystem& system, const string& command, const vector<string>& args) {
+    if (command == "backup") {
+        if (args.empty()) {
+            cerr << "Usage: backup <target-dir> [KB/s]\n";
+            return 2;
+        }
+        uint64_t rate = args.size() > 1 ? stoull(args[1]) * 1024 : 0;
+        system.startBackup(args[0], rate);
+        return system.waitForBackup() ? 0 : 1;
+    }
+    if (command == "export-delta") {
+        if (args.size() < 2) {
+            cerr << "Usage: export-delta <since-version> <output-file>\n";
+            return 2;
+        }
+        ofstream out(args[1]);
+        if (!out.is_open()) {
+            cerr << "Failed to open " << args[1] << "\n";
+            return 1;
+        }
+        size_t count = system.exportChanges(stoull(args[0]), out);
+        cout << count << " changed record(s) exported up to version "
+             << system.getCommitTimestamp() << "\n";
+        return 0;
+    }
+    if (command == "export-by-user" || command == "applicant-totals") {
+        if (args.empty()) {
+            cerr << "Usage: " << command << " <output-file> [memory-MB]\n";
+            return 2;
+        }
+        if (args.size() > 1) system.setReportMemoryLimit(stoull(args[1]) << 20);
+        ofstream out(args[0]);
+        if (!out.is_open()) {
+            cerr << "Failed to open " << args[0] << "\n";
+            return 1;
+        }
+        ReportSnapshot snapshot(system);
+        size_t count = command == "export-by-user"
+            ? exportApplicationsByUser(snapshot.applications(), system.getTempDirectory(),
+                                       system.getReportMemoryLimit(), out)
+            : exportApplicantTotals(snapshot.applications(), system.getTempDirectory(),
+                                    system.getReportMemoryLimit(), out);
+        cout << count << " record(s) written to " << args[0] << "\n";
+        return 0;
+    }
+    if (command == "export-columnar") {
+        if (args.empty()) {
+            cerr << "Usage: export-columnar <target-dir>\n";
+            return 2;
+        }
+        makeDirectory(args[0]);
+        ReportSnapshot snapshot(system);
+        exportPetsColumnar(snapshot.pets(), args[0] + "/pets.pcol");
+        exportApplicationsColumnar(snapshot.applications(), args[0] + "/applications.pcol");
+        cout << "Version " << snapshot.timestamp() << " exported to " << args[0] << "\n";
+        return 0;
+    }
+    if (command == "read-columnar") {
+        if (args.size() < 2) {
+            cerr << "Usage: read-columnar <file.pcol> <output.csv> [column,column,...]\n";
+            return 2;
+        }
+        vector<string> columns;
+        if (args.size() > 2) {
+            stringstream list(args[2]);
+            string column;
+            while (getline(list, column, ',')) columns.push_back(column);
+        }
+        ofstream out(args[1]);
+        if (!out.is_open()) {
+            cerr << "Failed to open " << args[1] << "\n";
+            return 1;
+        }
+        printColumnarFile(args[0], columns, out);
+        return 0;
+    }
+    if (command == "import-jsonl" || command == "export-jsonl") {
+        if (args.size() < 2) {
+            cerr << "Usage: " << command << " <pets|applications|users> <file>\n";
+            return 2;
+        }
+        return runJsonLinesTransfer(system, command == "import-jsonl", args[0], args[1]);
+    }
+    if (command == "bench-jsonl") {
+        if (args.empty()) {
+            cerr << "Usage: bench-jsonl <pet-count> (imports the pets; use a scratch --data-dir=DIR)\n";
+            return 2;
+        }
+        return runJsonLinesBenchmark(system, stoul(args[0]));
+    }
+    if (command == "bench-analytics") {
+        if (args.size() < 3) {
+            cerr << "Usage: bench-analytics <applications> <applicants> <pets> [threads]\n";
+            return 2;
+        }
+        return runAnalyticsBenchmark(stoul(args[0]), stoul(args[1]), stoul(args[2]),
+                                     args.size() > 3 ? static_cast<unsigned>(stoul(args[3])) : 0);
+    }
+    if (command == "import-csv") {
+        if (args.empty()) {
+            cerr << "Usage: import-csv <pets.csv>\n";
+            return 2;
+        }
+        ifstream in(args[0], ios::binary);
+        if (!in.is_open()) {
+            cerr << "Failed to open " << args[0] << "\n";
+            return 1;
+        }
+        ImportResult result = PetCsvImporter(system).run(in);
+        result.print("pets");
+        return result.rejected == 0 ? 0 : 1;
+    }
+    if (command == "migrate") {
+        // Opening the shelter started the migration of any legacy files
+        system.waitForMigration();
+        string status = system.getMigrationStatus();
+        cout << (status.empty() ? "All data files are up to date." : status) << "\n";
+        return status.find("failed") == string::npos ? 0 : 1;
+    }
+    if (command == "popularity") {
+        size_t k = args.empty() ? 10 : stoul(args[0]);
+        printPopularity(system.getApplicationSketches(), k);
+        return 0;
+    }
+    if (command == "list-pets") {
+        size_t page = args.size() > 1 ? stoul(args[1]) : 1;
+        size_t pageSize = args.size() > 2 ? stoul(args[2]) : 20;
+        if (args.empty() || (args[0] != "name" && args[0] != "age") || page == 0 || pageSize == 0) {
+            cerr << "Usage: list-pets <name|age> [page] [page-size]\n";
+            return 2;
+        }
+        const PetTable& pets = system.getAllPets();
+        size_t first = (page - 1) * pageSize;
+        cout << "rank,name,breed,age,vaccinated,status\n";
+        for (size_t position : system.getPetPage(args[0] == "name" ? PETS_BY_NAME : PETS_BY_AGE,
+                                                 first, pageSize)) {
+            const Pet& pet = pets[position];
+            cout << ++first << "," << pet.getName() << "," << pet.getBreed() << "," << pet.getAge()
+                 << "," << (pet.isVaccinated() ? "Yes" : "No") << ","
+                 << (pet.isAdopted() ? "Adopted" : "Available") << "\n";
+        }
+        cout << "Page " << page << " of " << (pets.size() + pageSize - 1) / pageSize << "\n";
+        return 0;
+    }
+    if (command == "query") {
+        if (args.empty()) {
+            cerr << "Usage: query <expression>, e.g. query 'breed ~ \"lab\" and age <= 3'\n";
+            return 2;
+        }
+        string text = args[0];
+        for (size_t i = 1; i < args.size(); ++i) text += " " + args[i];
+        vector<size_t> matches;
+        try {
+            matches = system.queryPets(PetQuery::compile(text));
+        } catch (const InvalidInputException& e) {
+            cerr << "Invalid query: " << e.what() << "\n";
+            return 2;
+        }
+        const PetTable& pets = system.getAllPets();
+        cout << "name,breed,age,vaccinated,status\n";
+        for (size_t position : matches) {
+            const Pet& pet = pets[position];
+            cout << pet.getName() << "," << pet.getBreed() << "," << pet.getAge() << ","
+                 << (pet.isVaccinated() ? "Yes" : "No") << "," << (pet.isAdopted() ? "Adopted" : "Available") << "\n";
+        }
+        cout << matches.size() << " pet(s) matched\n";
+        return 0;
+    }
+    if (command == "analytics") {
+        unsigned threads = args.empty() ? 0 : static_cast<unsigned>(stoul(args[0]));
+        ReportSnapshot snapshot(system);
+        printAdoptionAnalytics(
+            AdoptionAnalytics::compute(snapshot.pets(), snapshot.applications(), threads),
+            snapshot.timestamp());
+        return 0;
+    }
+    cerr << "Unknown command: " << command << "\n";
+    return 2;
+}
+
+// Usage: petadoptionsystem [name=dataDir ...] [--flush-every=N]
+//        petadoptionsystem <command> [args...] [--data-dir=DIR] [--flush-every=N]
+// Without arguments the default shelter in the working directory is used.
+// --flush-every=N saves each shelter after every N changes instead of after
+// each one; pending changes are still saved on exit.
+int main(int argc, char* argv[]) {
     try {
-        PetAdoptionSystem& system = PetAdoptionSystem::getInstance();
-        system.run();
+        ShelterRegistry& registry = ShelterRegistry::getInstance();
+        size_t flushEvery = 1;
+        vector<string> arguments;
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg.compare(0, 14, "--flush-every=") == 0) {
+                flushEvery = stoul(arg.substr(14));
+            } else {
+                arguments.push_back(arg);
+            }
+        }
+        if (arguments.empty()) {
+            PetAdoptionSystem& system = PetAdoptionSystem::getInstance();
+            system.setFlushBatchSize(flushEvery);
+            system.run();
+            return 0;
+        }
+        
+        if (isBatchCommand(arguments[0])) {
+            string dataDir = ".";
+            vector<string> args;
+            for (size_t i = 1; i < arguments.size(); ++i) {
+                const string& arg = arguments[i];
+                if (arg.compare(0, 11, "--data-dir=") == 0) {
+                    dataDir = arg.substr(11);
+                } else {
+                    args.push_back(arg);
+                }
+            }
+            PetAdoptionSystem& system = registry.open("batch", dataDir);
+            system.setFlushBatchSize(flushEvery);
+            return runBatchCommand(system, arguments[0], args);
+        }
+        
+        for (const string& arg : arguments) {
+            size_t eq = arg.find('=');
+            if (eq == string::npos) {
+                registry.open(arg, arg);
+            } else {
+                registry.open(arg.substr(0, eq), arg.substr(eq + 1));
+            }
+        }
+        
+        vector<string> names = registry.getShelterNames();
+        for (const auto& name : names) registry.get(name).setFlushBatchSize(flushEvery);
+        if (names.size() == 1) {
+            registry.get(names[0]).run();
+            return 0;
+        }
+        
+        while (true) {
+            cout << "\n=== SELECT SHELTER ===\n";
+            for (size_t i = 0; i < names.size(); ++i) {
+                cout << i+1 << ". " << names[i] << "\n";
+            }
+            cout << "0. Exit\n";
+            cout << "Enter choice: ";
+            
+            string input;
+            if (!getline(cin, input)) break;
+            if (!regex_match(input, regex("^\\s*\\d+\\s*$"))) continue;
+            size_t choice = stoul(input);
+            if (choice == 0) break;
+            if (choice <= names.size()) {
+                registry.get(names[choice-1]).run();
+                registry.get(names[choice-1]).flush();
+            }
+        }
     } catch (const exception& e) {
         cerr << "Fatal error: " << e.what() << endl;
         return 1;